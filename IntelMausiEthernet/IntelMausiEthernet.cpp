@@ -21,6 +21,7 @@
 
 #include "IntelMausiEthernet.h"
 #include <kdp/kdp_support.h>
+#include <IOKit/IOUserClient.h>
 
 #pragma mark --- private data ---
 
@@ -155,7 +156,10 @@ bool IntelMausi::init(OSDictionary *properties)
         mediumDict = NULL;
         txQueue = NULL;
         interruptSource = NULL;
+        rxBudgetSource = NULL;
         timerSource = NULL;
+        txReclaimTimer = NULL;
+        txHangTimer = NULL;
         netif = NULL;
         netStats = NULL;
         etherStats = NULL;
@@ -176,10 +180,39 @@ bool IntelMausi::init(OSDictionary *properties)
         linkUp = false;
 #ifdef __PRIVATE_SPI__
         polling = false;
+        pollModeStart = 0;
+        pollTimePeriod = 0;
+        pollCallsPeriod = 0;
+        pollPacketsPeriod = 0;
+        pollSwitchesPeriod = 0;
+        pollThresholdScale = 1;
+        bzero(&pollBaseParams, sizeof(pollBaseParams));
 #else
         stalled = false;
+        txPendingPackets = 0;
 #endif /* __PRIVATE_SPI__ */
         forceReset = false;
+        forceGSO = false;
+        txGSOPacket = NULL;
+        txGSONextSeg = 0;
+        txBounceDmaCmd = NULL;
+        txBounceDesc = NULL;
+        txBouncePhyAddr = 0;
+        txBounceArray = NULL;
+        txPrioDescDmaCmd = NULL;
+        txPrioBufDesc = NULL;
+        txPrioPhyAddr = 0;
+        txPrioDescArray = NULL;
+        txPrioNumFreeDesc = 0;
+        txPrioNextDescIndex = 0;
+        txPrioDirtyIndex = 0;
+        txPrioCleanBarrierIndex = 0;
+        enableTxPrioQueue = false;
+        bzero(&txPrioBufArray, sizeof(txPrioBufArray));
+        bzero(&txPrioContext, sizeof(txPrioContext));
+#ifdef __PRIVATE_SPI__
+        txPendingPacket = NULL;
+#endif /* __PRIVATE_SPI__ */
         eeeMode = 0;
         chip = 0;
         powerState = 0;
@@ -194,6 +227,63 @@ bool IntelMausi::init(OSDictionary *properties)
         wolCapable = false;
         wolActive = false;
         enableCSO6 = false;
+        enableTSO4 = false;
+        enableTSO6 = false;
+        txCopybreak = 0;
+        txInflightBytes = 0;
+        txBQLLimit = kTxBQLNoLimit;
+        txBQLMinSlack = kTxBQLNoLimit;
+        txBQLLimited = false;
+        txBQLStarved = false;
+        enableTxBQL = false;
+        numTxDesc = kNumTxDescDefault;
+        numRxDesc = kNumRxDescDefault;
+        txDescMask = numTxDesc - 1;
+        rxDescMask = numRxDesc - 1;
+        rxBufferSize = kRxBufferPktSize;
+        txBufArray = NULL;
+        rxBufArray = NULL;
+        rxPSBufArray = NULL;
+        rxPSDescArray = NULL;
+        rxPSHdrDmaCmd = NULL;
+        rxPSHdrBufDesc = NULL;
+        rxPSHdrPhyAddr = 0;
+        rxPSHdrArray = NULL;
+        rxPSNumPages = 0;
+        rxPacketSplit = false;
+        enableRxPacketSplit = false;
+        rxPoolBufSize = kRxBufferPktSize;
+        rxPoolHead = 0;
+        rxPoolCount = 0;
+        bzero(&rxPoolArray, sizeof(rxPoolArray));
+        rxCopybreak = kRxCopybreakDefault;
+        rxCopybreakInit = kRxCopybreakDefault;
+        rxCopybreakErrors = 0;
+        rxCopybreakMissed = 0;
+        rxBudget = kRxBudgetDefault;
+        rxBudgetPending = false;
+        enableRxLRO = false;
+        bzero(&rxLro, sizeof(rxLro));
+        vlanFilterCount = 0;
+        bzero(&vlanFilterTable, sizeof(vlanFilterTable));
+        enableAdaptiveITR = false;
+        itrRate = 0;
+        itrRxClass = itrTxClass = kItrLowLatency;
+        itrRxPackets = itrRxBytes = 0;
+        itrTxPackets = itrTxBytes = 0;
+        txCoalesceNext = 0;
+        txCoalesceFree = 0;
+        txReclaimPercent = kTxReclaimWatermarkDefault;
+        txReclaimWatermark = 0;
+        txReclaimTimeout = kTxReclaimTimeoutDefault;
+        txReclaimTimerArmed = false;
+        txHangTimeout = kTxHangTimeoutDefault;
+        txHangHead = 0;
+        txPrioHangHead = 0;
+        txHangProgressTime = 0;
+        txHangTimerArmed = false;
+        bzero(&drvStats, sizeof(drvStats));
+        bzero(&txContext, sizeof(txContext));
         pciPMCtrlOffset = 0;
         maxLatency = 0;
         debugger = NULL;
@@ -215,10 +305,22 @@ void IntelMausi::free()
             workLoop->removeEventSource(interruptSource);
             RELEASE(interruptSource);
         }
+        if (rxBudgetSource) {
+            workLoop->removeEventSource(rxBudgetSource);
+            RELEASE(rxBudgetSource);
+        }
         if (timerSource) {
             workLoop->removeEventSource(timerSource);
             RELEASE(timerSource);
         }
+        if (txReclaimTimer) {
+            workLoop->removeEventSource(txReclaimTimer);
+            RELEASE(txReclaimTimer);
+        }
+        if (txHangTimer) {
+            workLoop->removeEventSource(txHangTimer);
+            RELEASE(txHangTimer);
+        }
         workLoop->release();
         workLoop = NULL;
     }
@@ -362,10 +464,22 @@ void IntelMausi::stop(IOService *provider)
             workLoop->removeEventSource(interruptSource);
             RELEASE(interruptSource);
         }
+        if (rxBudgetSource) {
+            workLoop->removeEventSource(rxBudgetSource);
+            RELEASE(rxBudgetSource);
+        }
         if (timerSource) {
             workLoop->removeEventSource(timerSource);
             RELEASE(timerSource);
         }
+        if (txReclaimTimer) {
+            workLoop->removeEventSource(txReclaimTimer);
+            RELEASE(txReclaimTimer);
+        }
+        if (txHangTimer) {
+            workLoop->removeEventSource(txHangTimer);
+            RELEASE(txHangTimer);
+        }
         workLoop->release();
         workLoop = NULL;
     }
@@ -570,6 +684,10 @@ void IntelMausi::receivePacket(void *pkt, UInt32 *pktSizeOut, UInt32 timeout)
 
     *pktSizeOut = 0;
 
+    /* The debugger doesn't support the packet split descriptor format. */
+    if (rxPacketSplit)
+        return;
+
     /* WARNING: This routine is NOT allowed to allocate memory or block the thread (e.g. use mutexes, IOSleep). */
 
     while (!isReceived && costTime < timeout) {
@@ -614,7 +732,7 @@ void IntelMausi::receivePacket(void *pkt, UInt32 *pktSizeOut, UInt32 timeout)
             desc->read.buffer_addr = OSSwapHostToLittleInt64(addr);
             desc->read.reserved = 0;
 
-            ++rxNextDescIndex &= kRxDescMask;
+            ++rxNextDescIndex &= rxDescMask;
             desc = &rxDescArray[rxNextDescIndex];
             rxCleanedCount++;
         }
@@ -631,9 +749,9 @@ void IntelMausi::receivePacket(void *pkt, UInt32 *pktSizeOut, UInt32 timeout)
          * buffer queue full condition.
          */
         if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-            intelUpdateRxDescTail((rxNextDescIndex - 1) & kRxDescMask);
+            intelUpdateRxDescTail((rxNextDescIndex - 1) & rxDescMask);
         else
-            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & kRxDescMask);
+            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & rxDescMask);
 
         rxCleanedCount = 0;
     }
@@ -642,23 +760,10 @@ void IntelMausi::receivePacket(void *pkt, UInt32 *pktSizeOut, UInt32 timeout)
 void IntelMausi::sendPacket(void *pkt, UInt32 pktSize)
 {
     IOPhysicalSegment txSegments[kMaxSegs];
-    struct e1000_data_desc *desc;
-    struct e1000_context_desc *contDesc;
     mbuf_t m;
-    UInt32 numDescs;
-    UInt32 cmd;
-    UInt32 opts;
-    UInt32 word2;
-    UInt32 len;
-    UInt32 mss;
-    UInt32 ipConfig;
-    UInt32 tcpConfig;
-    UInt32 word1;
     UInt32 numSegs;
-    UInt32 lastSeg;
-    UInt32 index;
     UInt32 offloadFlags;
-    UInt16 vlanTag;
+    UInt32 csumData;
     UInt16 i;
 
     /* WARNING: This routine is NOT allowed to allocate memory or block the thread (e.g. use mutexes, IOSleep). */
@@ -704,70 +809,13 @@ void IntelMausi::sendPacket(void *pkt, UInt32 pktSize)
         return;
     }
 
-    numDescs = 0;
-    cmd = 0;
-    opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
-    word2 = 0;
-    len = 0;
-    mss = 0;
-    ipConfig = 0;
-    tcpConfig = 0;
     offloadFlags = 0;
 
-    /* First prepare the header and the command bits. */
-    mbuf_get_csum_requested(m, &offloadFlags, &mss);
-
-    if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
-        numDescs = 1;
-        cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
-
-        if (offloadFlags & kChecksumTCP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
-            mss = 0;
-
-            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-        } else if (offloadFlags & kChecksumUDP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-            mss = 0;
-
-            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-        } else if (offloadFlags & kChecksumIP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = 0;
-            mss = 0;
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-
-            word2 = E1000_TXD_OPTS_IXSM;
-        } else if (offloadFlags & kChecksumTCPIPv6) {
-            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-            tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
-            mss = 0;
-
-            word2 = E1000_TXD_OPTS_TXSM;
-        } else if (offloadFlags & kChecksumUDPIPv6) {
-            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-            tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart);
-            len = E1000_TXD_CMD_DEXT;
-            mss = 0;
-
-            word2 = E1000_TXD_OPTS_TXSM;
-        }
-    }
-
-    /* Next get the VLAN tag and command bit. */
-    if (!mbuf_get_vlan_tag(m, &vlanTag)) {
-        opts |= E1000_TXD_CMD_VLE;
-        word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
-    }
+    /* First get the offload parameters. */
+    mbuf_get_csum_requested(m, &offloadFlags, &csumData);
 
-    /* Finally get the physical segments. */
+    /* Next get the physical segments. */
     numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, &txSegments[0], kMaxSegs);
-    numDescs += numSegs;
 
     if (!numSegs) {
         DebugLog("[IntelMausi]: getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
@@ -775,48 +823,9 @@ void IntelMausi::sendPacket(void *pkt, UInt32 pktSize)
         freePacketEx(m, kDelayFree);
         return;
     }
-
-    OSAddAtomic(-numDescs, &txNumFreeDesc);
-    index = txNextDescIndex;
-    txNextDescIndex = (txNextDescIndex + numDescs) & kTxDescMask;
-    lastSeg = numSegs - 1;
-
-    /* Setup the context descriptor for TSO or checksum offload. */
-    if (offloadFlags) {
-        contDesc = (struct e1000_context_desc *)&txDescArray[index];
-
-        txBufArray[index].mbuf = NULL;
-        txBufArray[index].numDescs = 0;
-
-        contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
-        contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
-        contDesc->cmd_and_length = OSSwapHostToLittleInt32(len);
-        contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(mss);
-
-        ++index &= kTxDescMask;
-    }
-
-    /* And finally fill in the data descriptors. */
-    for (i = 0; i < numSegs; i++) {
-        desc = &txDescArray[index];
-        word1 = (cmd | (txSegments[i].length & 0x000fffff));
-
-        if (i == lastSeg) {
-            word1 |= opts;
-            txBufArray[index].mbuf = m;
-            txBufArray[index].numDescs = numDescs;
-        } else {
-            txBufArray[index].mbuf = NULL;
-            txBufArray[index].numDescs = 0;
-        }
-
-        desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-        desc->lower.data = OSSwapHostToLittleInt32(word1);
-        desc->upper.data = OSSwapHostToLittleInt32(word2);
-
-        ++index &= kTxDescMask;
-    }
-
+    /* And finally fill in the descriptors. */
+    intelTxFillDescs(txDescArray, txBufArray, &txNextDescIndex, &txNumFreeDesc, txDescMask, &txContext,
+                     m, &txSegments[0], numSegs, getTxOffload(offloadFlags));
     intelUpdateTxDescTail(txNextDescIndex);
 }
 
@@ -835,12 +844,18 @@ IOReturn IntelMausi::driverEnable()
         IOLog("[IntelMausi]: Unable to open PCI device.\n");
         goto done;
     }
+    if (!txBufArray || !rxBufArray) {
+        IOLog("[IntelMausi]: Descriptor rings missing.\n");
+        goto done;
+    }
     pciDevice->open(this);
 
     intelEnable();
 
     /* As we are using an msi the interrupt hasn't been enabled by start(). */
     interruptSource->enable();
+    rxBudgetSource->enable();
+    rxBudgetPending = false;
 
     rxPacketHead = rxPacketTail = NULL;
     rxPacketSize = 0;
@@ -850,6 +865,7 @@ IOReturn IntelMausi::driverEnable()
 
 #ifdef __PRIVATE_SPI__
     polling = false;
+    pollModeStart = mach_absolute_time();
 #else
     txQueue->setCapacity(kTransmitQueueCapacity);
     stalled = false;
@@ -894,10 +910,16 @@ IOReturn IntelMausi::driverDisable()
     eeeMode = 0;
 
     timerSource->cancelTimeout();
+    txReclaimTimer->cancelTimeout();
+    txReclaimTimerArmed = false;
+    txHangTimer->cancelTimeout();
+    txHangTimerArmed = false;
     txDescDoneCount = txDescDoneLast = 0;
 
     /* We are using MSI so that we have to disable the interrupt. */
     interruptSource->disable();
+    rxBudgetSource->disable();
+    rxBudgetPending = false;
 
     intelDisable();
 
@@ -920,158 +942,136 @@ done:
 IOReturn IntelMausi::outputStart(IONetworkInterface *interface, IOOptionBits options)
 {
     IOPhysicalSegment txSegments[kMaxSegs];
-    struct e1000_data_desc *desc;
-    struct e1000_context_desc *contDesc;
+    struct intelTxOffload tsoOffload;
+    const struct intelTxOffload *offload;
     mbuf_t m;
     IOReturn result = kIOReturnNoResources;
-    UInt32 numDescs;
-    UInt32 cmd;
-    UInt32 opts;
-    UInt32 word2;
-    UInt32 len;
-    UInt32 mss;
-    UInt32 ipConfig;
-    UInt32 tcpConfig;
-    UInt32 word1;
     UInt32 numSegs;
-    UInt32 lastSeg;
-    UInt32 index;
+    UInt32 pktLen;
     UInt32 offloadFlags;
-    UInt16 vlanTag;
-    UInt16 i;
+    UInt32 csumData;
+    UInt32 tsoFlags;
+    UInt32 tsoMss;
+    UInt32 batch;
+    UInt32 n;
     UInt16 count;
+    UInt16 prioCount;
+    bool coalesced;
+    bool gso;
 
     //DebugLog("[IntelMausi]: outputStart() ===>\n");
     count = 0;
+    prioCount = 0;
 
     if (!(isEnabled && linkUp) || forceReset) {
         DebugLog("[IntelMausi]: Interface down. Dropping packets.\n");
         goto done;
     }
-    while ((txNumFreeDesc >= (kMaxSegs + kTxSpareDescs)) && (interface->dequeueOutputPackets(1, &m, NULL, NULL, NULL) == kIOReturnSuccess)) {
-        numDescs = 0;
-        cmd = 0;
-        opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
-        word2 = 0;
-        len = 0;
-        mss = 0;
-        ipConfig = 0;
-        tcpConfig = 0;
-        offloadFlags = 0;
+    while ((txNumFreeDesc >= (kMaxSegs + kTxSpareDescs)) && ((UInt32)txInflightBytes < txBQLLimit)) {
+        /*
+         * Dequeue as many packets as fit into the ring at once. Packets
+         * which couldn't be sent yet are left in txPendingPacket and
+         * must go out first.
+         */
+        if (!txPendingPacket) {
+            batch = (txNumFreeDesc - kTxSpareDescs) / kMaxSegs;
 
-        /* First prepare the header and the command bits. */
-        mbuf_get_csum_requested(m, &offloadFlags, &mss);
-
-        if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
-            numDescs = 1;
-            cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
-
-            if (offloadFlags & kChecksumTCP) {
-                ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
-                len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
-                mss = 0;
-
-                word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-            } else if (offloadFlags & kChecksumUDP) {
-                ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart);
-                len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-                mss = 0;
-
-                word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-            } else if (offloadFlags & kChecksumIP) {
-                ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-                tcpConfig = 0;
-                mss = 0;
-                len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-
-                word2 = E1000_TXD_OPTS_IXSM;
-            } else if (offloadFlags & kChecksumTCPIPv6) {
-                ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-                tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
-                len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
-                mss = 0;
-
-                word2 = E1000_TXD_OPTS_TXSM;
-            } else if (offloadFlags & kChecksumUDPIPv6) {
-                ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-                tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart);
-                len = E1000_TXD_CMD_DEXT;
-                mss = 0;
-
-                word2 = E1000_TXD_OPTS_TXSM;
-            }
-        }
+            if (interface->dequeueOutputPackets(batch, &txPendingPacket, NULL, &n, NULL) != kIOReturnSuccess)
+                break;
 
-        /* Next get the VLAN tag and command bit. */
-        if (!mbuf_get_vlan_tag(m, &vlanTag)) {
-            opts |= E1000_TXD_CMD_VLE;
-            word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+            drvStats.txDequeueBatches++;
+            drvStats.txDequeuePackets += n;
         }
-        /* Finally get the physical segments. */
-        numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, &txSegments[0], kMaxSegs);
-        numDescs += numSegs;
+        m = txPendingPacket;
+        txPendingPacket = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, NULL);
 
-        if (!numSegs) {
-            DebugLog("[IntelMausi]: getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
-            etherStats->dot3TxExtraEntry.resourceErrors++;
-            freePacket(m);
+        /* Control and interactive traffic uses the priority ring. */
+        if (txPrioDescArray && intelIsPrioPacket(m) && intelTransmitPrio(m)) {
+            prioCount++;
             continue;
         }
-        OSAddAtomic(-numDescs, &txNumFreeDesc);
-        index = txNextDescIndex;
-        txNextDescIndex = (txNextDescIndex + numDescs) & kTxDescMask;
-        lastSeg = numSegs - 1;
 
-        /* Setup the context descriptor for checksum offload. */
-        if (offloadFlags) {
-            contDesc = (struct e1000_context_desc *)&txDescArray[index];
+        offloadFlags = 0;
+        tsoFlags = 0;
+        numSegs = 0;
+        coalesced = false;
 
-            txBufArray[index].mbuf = NULL;
-            txBufArray[index].numDescs = 0;
+        /* First prepare the offload parameters. */
+        if (!mbuf_get_tso_requested(m, &tsoFlags, &tsoMss) && tsoFlags) {
+            numSegs = intelSetupTSO(&m, tsoFlags, tsoMss, &txSegments[0], &tsoOffload, &gso);
 
-#ifdef DEBUG
-            txBufArray[index].pad = numSegs;
-#endif
+            if (!m)
+                continue;
 
-            contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
-            contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
-            contDesc->cmd_and_length = OSSwapHostToLittleInt32(len);
-            contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(mss);
+            if (gso) {
+                result = intelTransmitGSO(m, tsoFlags, tsoMss, &txSegments[0], numSegs);
 
-            ++index &= kTxDescMask;
-        }
-        /* And finally fill in the data descriptors. */
-        for (i = 0; i < numSegs; i++) {
-            desc = &txDescArray[index];
-            word1 = (cmd | (txSegments[i].length & 0x000fffff));
+                if (result == kIOReturnNoResources) {
+                    mbuf_setnextpkt(m, txPendingPacket);
+                    txPendingPacket = m;
+                    break;
+                }
+                if (result == kIOReturnSuccess)
+                    count++;
 
-            if (i == lastSeg) {
-                word1 |= opts;
-                txBufArray[index].mbuf = m;
-                txBufArray[index].numDescs = numDescs;
-            } else {
-                txBufArray[index].mbuf = NULL;
-                txBufArray[index].numDescs = 0;
+                continue;
             }
+        }
+        if (numSegs) {
+            offload = &tsoOffload;
+        } else {
+            mbuf_get_csum_requested(m, &offloadFlags, &csumData);
+            offload = getTxOffload(offloadFlags);
 
-#ifdef DEBUG
-            txBufArray[index].pad = (UInt32)txSegments[i].length;
-#endif
+            /* Small packets are copied into the bounce buffer. */
+            pktLen = (UInt32)mbuf_pkthdr_len(m);
 
-            desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-            desc->lower.data = OSSwapHostToLittleInt32(word1);
-            desc->upper.data = OSSwapHostToLittleInt32(word2);
+            if (pktLen <= txCopybreak) {
+                if (intelTransmitCopy(m, pktLen, offload))
+                    count++;
+                else
+                    freePacket(m);
+
+                continue;
+            }
+            /* Next get the physical segments. */
+            result = intelTxGetSegments(m, &txSegments[0], &numSegs, &coalesced);
 
-            ++index &= kTxDescMask;
+            if (result == kIOReturnNoResources) {
+                mbuf_setnextpkt(m, txPendingPacket);
+                txPendingPacket = m;
+                break;
+            }
+            if (result != kIOReturnSuccess) {
+                freePacket(m);
+                continue;
+            }
         }
+        /* And finally fill in the descriptors. */
+        intelTxFillDescs(txDescArray, txBufArray, &txNextDescIndex, &txNumFreeDesc, txDescMask, &txContext,
+                         m, &txSegments[0], numSegs, offload);
         count++;
+
+        if (coalesced)
+            intelTxDetachMbuf(m, true);
     }
-    if (count)
+    if (prioCount)
+        intelFlushTxPrio();
+
+    if (count) {
         intelUpdateTxDescTail(txNextDescIndex);
+        intelArmTxHangTimer();
 
-    result = (txNumFreeDesc >= (kMaxSegs + kTxSpareDescs)) ? kIOReturnSuccess : kIOReturnNoResources;
+        drvStats.txDoorbells++;
+        drvStats.txDoorbellPackets += count;
+    }
+    /* Remember when output has been held back by the byte queue limit. */
+    if ((UInt32)txInflightBytes >= txBQLLimit) {
+        txBQLLimited = true;
+        drvStats.txBQLStalls++;
+    }
+    result = (!txPendingPacket && (txNumFreeDesc >= (kMaxSegs + kTxSpareDescs)) && ((UInt32)txInflightBytes < txBQLLimit)) ? kIOReturnSuccess : kIOReturnNoResources;
 
     //DebugLog("[IntelMausi]: outputStart() <===\n");
 
@@ -1084,24 +1084,18 @@ done:
 UInt32 IntelMausi::outputPacket(mbuf_t m, void *param)
 {
     IOPhysicalSegment txSegments[kMaxSegs];
-    struct e1000_data_desc *desc;
-    struct e1000_context_desc *contDesc;
+    struct intelTxOffload tsoOffload;
+    const struct intelTxOffload *offload;
     UInt32 result = kIOReturnOutputDropped;
-    UInt32 numDescs = 0;
-    UInt32 cmd = 0;
-    UInt32 opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
-    UInt32 word2 = 0;
-    UInt32 len = 0;
-    UInt32 mss = 0;
-    UInt32 ipConfig = 0;
-    UInt32 tcpConfig = 0;
-    UInt32 word1;
-    UInt32 numSegs;
-    UInt32 lastSeg;
-    UInt32 index;
+    UInt32 numSegs = 0;
+    UInt32 pktLen = 0;
     UInt32 offloadFlags = 0;
-    UInt16 vlanTag;
-    UInt16 i;
+    UInt32 csumData = 0;
+    UInt32 tsoFlags = 0;
+    UInt32 tsoMss = 0;
+    bool copy = false;
+    bool coalesced = false;
+    bool gso;
 
     //DebugLog("[IntelMausi]: outputPacket() ===>\n");
 
@@ -1109,157 +1103,120 @@ UInt32 IntelMausi::outputPacket(mbuf_t m, void *param)
         DebugLog("[IntelMausi]: Interface down. Dropping packet.\n");
         goto error;
     }
-    if (mbuf_get_tso_requested(m, &offloadFlags, &mss)) {
-        DebugLog("[IntelMausi]: mbuf_get_tso_requested() failed. Dropping packet.\n");
+    /* Control and interactive traffic uses the priority ring. */
+    if (txPrioDescArray && intelIsPrioPacket(m) && intelTransmitPrio(m)) {
+        intelFlushTxPrio();
+        result = kIOReturnOutputSuccess;
         goto done;
     }
-    /* First prepare the header and the command bits. */
-    mbuf_get_csum_requested(m, &offloadFlags, &mss);
-
-    if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
-        numDescs = 1;
-        cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
-
-        if (offloadFlags & kChecksumTCP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
-            mss = 0;
-
-            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-        } else if (offloadFlags & kChecksumUDP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-            mss = 0;
-
-            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
-        } else if (offloadFlags & kChecksumIP) {
-            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
-            tcpConfig = 0;
-            mss = 0;
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
-
-            word2 = E1000_TXD_OPTS_IXSM;
-        } else if (offloadFlags & kChecksumTCPIPv6) {
-            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-            tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
-            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
-            mss = 0;
-
-            word2 = E1000_TXD_OPTS_TXSM;
-        } else if (offloadFlags & kChecksumUDPIPv6) {
-            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
-            tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart);
-            len = E1000_TXD_CMD_DEXT;
-            mss = 0;
-
-            word2 = E1000_TXD_OPTS_TXSM;
-        }
-    }
-    /* Next get the VLAN tag and command bit. */
-    if (!mbuf_get_vlan_tag(m, &vlanTag)) {
-        opts |= E1000_TXD_CMD_VLE;
-        word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
-    }
-    /* Finally get the physical segments. */
-    numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, &txSegments[0], kMaxSegs);
-    numDescs += numSegs;
-
-    if (!numSegs) {
-        DebugLog("[IntelMausi]: getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
-        etherStats->dot3TxExtraEntry.resourceErrors++;
-        goto error;
-    }
-    /* Alloc required number of descriptors. We leave at least kTxSpareDescs unused. */
-    if ((txNumFreeDesc <= (numDescs + kTxSpareDescs))) {
-        DebugLog("[IntelMausi]: Not enough descriptors. Stalling.\n");
+    /* Hold back packets while the byte queue limit is exceeded. */
+    if ((UInt32)txInflightBytes >= txBQLLimit) {
+        txBQLLimited = true;
+        drvStats.txBQLStalls++;
         result = kIOReturnOutputStall;
         stalled = true;
         goto done;
     }
-    OSAddAtomic(-numDescs, &txNumFreeDesc);
-    index = txNextDescIndex;
-    txNextDescIndex = (txNextDescIndex + numDescs) & kTxDescMask;
-    lastSeg = numSegs - 1;
-
-    /* Setup the context descriptor for TSO or checksum offload. */
-    if (offloadFlags) {
-        contDesc = (struct e1000_context_desc *)&txDescArray[index];
-
-        txBufArray[index].mbuf = NULL;
-        txBufArray[index].numDescs = 0;
-
-#ifdef DEBUG
-        txBufArray[index].pad = 0;
-#endif
-
-        contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
-        contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
-        contDesc->cmd_and_length = OSSwapHostToLittleInt32(len);
-        contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(mss);
-
-        ++index &= kTxDescMask;
+    if (mbuf_get_tso_requested(m, &tsoFlags, &tsoMss)) {
+        DebugLog("[IntelMausi]: mbuf_get_tso_requested() failed. Dropping packet.\n");
+        goto error;
     }
-    /* And finally fill in the data descriptors. */
-    if (offloadFlags & (MBUF_TSO_IPV4 | MBUF_TSO_IPV6)) {
-        for (i = 0; i < numSegs; i++) {
-            desc = &txDescArray[index];
-            word1 = (cmd | (txSegments[i].length & 0x000fffff));
-
-            if (i == 0) {
-                word1 |= opts;
-                txBufArray[index].mbuf = NULL;
-                txBufArray[index].numDescs = 0;
-            } else if (i == lastSeg) {
-                word1 |= (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS);
-                txBufArray[index].mbuf = m;
-                txBufArray[index].numDescs = numDescs;
-            } else {
-                txBufArray[index].mbuf = NULL;
-                txBufArray[index].numDescs = 0;
-            }
-
-#ifdef DEBUG
-            txBufArray[index].pad = (UInt32)txSegments[i].length;
-#endif
+    /* First prepare the offload parameters. */
+    if (tsoFlags) {
+        /*
+         * TSO setup rewrites the packet's headers so that we must not
+         * stall after this point.
+         */
+        if (txNumFreeDesc <= (kMaxSegs + 1 + kTxSpareDescs)) {
+            DebugLog("[IntelMausi]: Not enough descriptors for TSO. Stalling.\n");
+            result = kIOReturnOutputStall;
+            stalled = true;
+            goto done;
+        }
+        numSegs = intelSetupTSO(&m, tsoFlags, tsoMss, &txSegments[0], &tsoOffload, &gso);
 
-            desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-            desc->lower.data = OSSwapHostToLittleInt32(word1);
-            desc->upper.data = OSSwapHostToLittleInt32(word2);
+        if (!m)
+            goto done;
 
-            ++index &= kTxDescMask;
+        if (gso) {
+            switch (intelTransmitGSO(m, tsoFlags, tsoMss, &txSegments[0], numSegs)) {
+                case kIOReturnSuccess:
+                    txPendingPackets++;
+                    result = kIOReturnOutputSuccess;
+                    break;
+
+                case kIOReturnNoResources:
+                    DebugLog("[IntelMausi]: Not enough descriptors. Stalling.\n");
+                    result = kIOReturnOutputStall;
+                    stalled = true;
+                    break;
+
+                default:
+                    break;
+            }
+            goto done;
         }
+    }
+    if (numSegs) {
+        offload = &tsoOffload;
     } else {
-        for (i = 0; i < numSegs; i++) {
-            desc = &txDescArray[index];
-            word1 = (cmd | (txSegments[i].length & 0x000fffff));
+        mbuf_get_csum_requested(m, &offloadFlags, &csumData);
+        offload = getTxOffload(offloadFlags);
 
-            if (i == lastSeg) {
-                word1 |= opts;
-                txBufArray[index].mbuf = m;
-                txBufArray[index].numDescs = numDescs;
-            } else {
-                txBufArray[index].mbuf = NULL;
-                txBufArray[index].numDescs = 0;
-            }
-
-#ifdef DEBUG
-            txBufArray[index].pad = (UInt32)txSegments[i].length;
-#endif
-
-            desc->buffer_addr = OSSwapHostToLittleInt64(txSegments[i].location);
-            desc->lower.data = OSSwapHostToLittleInt32(word1);
-            desc->upper.data = OSSwapHostToLittleInt32(word2);
+        /* Small packets are copied into the bounce buffer. */
+        pktLen = (UInt32)mbuf_pkthdr_len(m);
 
-            ++index &= kTxDescMask;
+        if (pktLen <= txCopybreak) {
+            numSegs = 1;
+            copy = true;
+        } else {
+            /* Next get the physical segments. */
+            switch (intelTxGetSegments(m, &txSegments[0], &numSegs, &coalesced)) {
+                case kIOReturnSuccess:
+                    break;
+
+                case kIOReturnNoResources:
+                    DebugLog("[IntelMausi]: Coalescing pool empty. Stalling.\n");
+                    result = kIOReturnOutputStall;
+                    stalled = true;
+                    goto done;
+
+                default:
+                    goto error;
+            }
         }
     }
-    intelUpdateTxDescTail(txNextDescIndex);
+    /* Make sure we have enough descriptors. We leave at least kTxSpareDescs unused. */
+    if (txNumFreeDesc <= (numSegs + 1 + kTxSpareDescs)) {
+        DebugLog("[IntelMausi]: Not enough descriptors. Stalling.\n");
+        result = kIOReturnOutputStall;
+        stalled = true;
+        goto done;
+    }
+    /* And finally fill in the descriptors. */
+    if (copy) {
+        if (!intelTransmitCopy(m, pktLen, offload))
+            goto error;
+    } else {
+        intelTxFillDescs(txDescArray, txBufArray, &txNextDescIndex, &txNumFreeDesc, txDescMask, &txContext,
+                         m, &txSegments[0], numSegs, offload);
+
+        if (coalesced)
+            intelTxDetachMbuf(m, true);
+    }
 
+    txPendingPackets++;
     result = kIOReturnOutputSuccess;
 
 done:
+    /*
+     * Ring the doorbell once per batch of packets. Don't wait for more
+     * packets in case the queue is empty or the current packet couldn't
+     * be sent.
+     */
+    if (txPendingPackets && ((txPendingPackets >= kTxDoorbellBatch) || (result != kIOReturnOutputSuccess) || !txQueue->getSize()))
+        intelFlushTxBatch();
+
     //DebugLog("[IntelMausi]: outputPacket() <===\n");
 
     return result;
@@ -1269,6 +1226,16 @@ error:
     goto done;
 }
 
+void IntelMausi::intelFlushTxBatch()
+{
+    intelUpdateTxDescTail(txNextDescIndex);
+    intelArmTxHangTimer();
+
+    drvStats.txDoorbells++;
+    drvStats.txDoorbellPackets += txPendingPackets;
+    txPendingPackets = 0;
+}
+
 #endif /* __PRIVATE_SPI__ */
 
 void IntelMausi::getPacketBufferConstraints(IOPacketBufferConstraints *constraints) const
@@ -1290,6 +1257,61 @@ IOOutputQueue* IntelMausi::createOutputQueue()
     return IOBasicOutputQueue::withTarget(this);
 }
 
+IOReturn IntelMausi::setProperties(OSObject *properties)
+{
+    OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+    OSArray *vlans;
+    OSNumber *txNum;
+    OSNumber *rxNum;
+    IOReturn result = kIOReturnUnsupported;
+    UInt32 txSize;
+    UInt32 rxSize;
+
+    DebugLog("[IntelMausi]: setProperties() ===>\n");
+
+    if (!dict)
+        goto done;
+
+    /* The ring sizes and the VLAN filter are the only properties which can be changed. */
+    txNum = OSDynamicCast(OSNumber, dict->getObject(kNumTxDescName));
+    rxNum = OSDynamicCast(OSNumber, dict->getObject(kNumRxDescName));
+    vlans = OSDynamicCast(OSArray, dict->getObject(kVlanFilterName));
+
+    if (!txNum && !rxNum && !vlans)
+        goto done;
+
+    result = IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator);
+
+    if (result != kIOReturnSuccess)
+        goto done;
+
+    if (vlans) {
+        result = commandGate->runAction(setVlanFilterAction, vlans);
+
+        if ((result != kIOReturnSuccess) || (!txNum && !rxNum))
+            goto done;
+    }
+    txSize = (txNum) ? txNum->unsigned32BitValue() : numTxDesc;
+    rxSize = (rxNum) ? rxNum->unsigned32BitValue() : numRxDesc;
+
+    if (!kIsValidRingSize(txSize) || !kIsValidRingSize(rxSize)) {
+        IOLog("[IntelMausi]: Invalid ring size. Use a power of 2 from %u to %u.\n", kMinNumDesc, kMaxNumDesc);
+        result = kIOReturnBadArgument;
+        goto done;
+    }
+    if ((enableTSO4 || enableTSO6) && (txSize < kMinNumTSODesc)) {
+        IOLog("[IntelMausi]: TSO needs at least %u tx descriptors.\n", kMinNumTSODesc);
+        result = kIOReturnBadArgument;
+        goto done;
+    }
+    result = commandGate->runAction(resizeRingsAction, (void *)(uintptr_t)txSize, (void *)(uintptr_t)rxSize);
+
+done:
+    DebugLog("[IntelMausi]: setProperties() <===\n");
+
+    return result;
+}
+
 const OSString* IntelMausi::newVendorString() const
 {
     DebugLog("[IntelMausi]: newVendorString() ===>\n");
@@ -1357,7 +1379,7 @@ bool IntelMausi::configureInterface(IONetworkInterface *interface)
         result = false;
         goto done;
     }
-    error = interface->configureInputPacketPolling(kNumRxDesc, kIONetworkWorkLoopSynchronous);
+    error = interface->configureInputPacketPolling(numRxDesc, kIONetworkWorkLoopSynchronous);
 
     if (error != kIOReturnSuccess) {
         IOLog("[IntelMausi]: configureInputPacketPolling() failed\n.");
@@ -1403,7 +1425,11 @@ IOReturn IntelMausi::setPromiscuousMode(bool active)
     DebugLog("[IntelMausi]: setPromiscuousMode() ===>\n");
 
     rxControl = intelReadMem32(E1000_RCTL);
-    rxControl &= ~(E1000_RCTL_UPE | E1000_RCTL_MPE);
+    rxControl &= ~(E1000_RCTL_UPE | E1000_RCTL_MPE | E1000_RCTL_VFE | E1000_RCTL_CFIEN);
+
+    /* Promiscuous mode sees all VLANs. */
+    if (vlanFilterCount && !active)
+        rxControl |= E1000_RCTL_VFE;
 
     if (active) {
         DebugLog("[IntelMausi]: Promiscuous mode enabled.\n");
@@ -1511,6 +1537,12 @@ UInt32 IntelMausi::getFeatures() const
 
     DebugLog("[IntelMausi]: getFeatures() ===>\n");
 
+    if (enableTSO4)
+        features |= kIONetworkFeatureTSOIPv4;
+
+    if (enableTSO6)
+        features |= kIONetworkFeatureTSOIPv6;
+
     DebugLog("[IntelMausi]: getFeatures() <===\n");
 
     return features;
@@ -1634,6 +1666,7 @@ IOReturn IntelMausi::getMaxPacketSize(UInt32 * maxSize) const
 IOReturn IntelMausi::setMaxPacketSize(UInt32 maxSize)
 {
     IOReturn result = kIOReturnError;
+    UInt32 oldMtu = mtu;
 
     DebugLog("[IntelMausi]: setMaxPacketSize() ===>\n");
 
@@ -1643,6 +1676,16 @@ IOReturn IntelMausi::setMaxPacketSize(UInt32 maxSize)
 
         DebugLog("[IntelMausi]: maxSize: %u, mtu: %u\n", maxSize, mtu);
 
+        /* The receive buffers have to be reallocated when their size changes. */
+        if (kRxBufferSize(mtu) != rxBufferSize) {
+            result = intelResizeRings(numTxDesc, numRxDesc, kRxBufferSize(mtu));
+
+            if (result != kIOReturnSuccess) {
+                mtu = oldMtu;
+                adapterData.max_frame_size = oldMtu + ETH_HLEN + ETH_FCS_LEN;
+            }
+            goto done;
+        }
         /* Force reinitialization. */
         setLinkDown();
         timerSource->cancelTimeout();
@@ -1652,6 +1695,7 @@ IOReturn IntelMausi::setMaxPacketSize(UInt32 maxSize)
         result = kIOReturnSuccess;
     }
 
+done:
     DebugLog("[IntelMausi]: setMaxPacketSize() <===\n");
 
     return result;
@@ -1659,67 +1703,403 @@ IOReturn IntelMausi::setMaxPacketSize(UInt32 maxSize)
 
 #pragma mark --- common interrupt methods ---
 
-void IntelMausi::txInterrupt(IOOptionBits options)
+/*
+ * Release the buffers of a completed packet whose last descriptor is at index.
+ * Returns the packet's size in bytes.
+ */
+inline UInt32 IntelMausi::intelTxReleasePacket(UInt32 index, UInt64 now, IOOptionBits options)
 {
-    UInt32 descStatus;
+    UInt32 bytes = txBufArray[index].bytes;
+    UInt64 held = now - txBufArray[index].time;
     SInt32 cleaned;
 
-    while (txDirtyIndex != txCleanBarrierIndex) {
-        if (txBufArray[txDirtyIndex].mbuf) {
-            descStatus = OSSwapLittleToHostInt32(txDescArray[txDirtyIndex].upper.data);
+    /* Copied packets have released their mbuf already. */
+    if (txBufArray[index].mbuf) {
+        freePacketEx(txBufArray[index].mbuf, options);
+        txBufArray[index].mbuf = NULL;
+    }
+    if (txBufArray[index].coalesced) {
+        txBufArray[index].coalesced = false;
+        OSIncrementAtomic(&txCoalesceFree);
+    }
+    cleaned = txBufArray[index].numDescs;
+    txBufArray[index].numDescs = 0;
 
-            if (!(descStatus & E1000_TXD_STAT_DD))
-                goto done;
+    /* Finally update the number of free descriptors and bytes in flight. */
+    OSAddAtomic(cleaned, &txNumFreeDesc);
+    OSAddAtomic(-(SInt32)bytes, &txInflightBytes);
+    txDescDoneCount += cleaned;
+    drvStats.txReclaimPackets++;
+    drvStats.txReclaimDescs += cleaned;
+    drvStats.txHoldTime += held;
 
-            /* First free the attached mbuf and clean up the buffer info. */
-            freePacketEx(txBufArray[txDirtyIndex].mbuf, options);
-            txBufArray[txDirtyIndex].mbuf = NULL;
+    if (held > drvStats.txHoldTimeMax)
+        drvStats.txHoldTimeMax = held;
 
-            cleaned = txBufArray[txDirtyIndex].numDescs;
-            txBufArray[txDirtyIndex].numDescs = 0;
+    return bytes;
+}
 
-            /* Finally update the number of free descriptors. */
-            OSAddAtomic(cleaned, &txNumFreeDesc);
-            txDescDoneCount += cleaned;
-        }
-        /* Increment txDirtyIndex. */
-        ++txDirtyIndex &= kTxDescMask;
-    }
+/*
+ * Adjust the tx byte queue limit after completion of a number of bytes.
+ * When the ring ran empty while output was held back by the limit, the
+ * limit has been too low and it's raised by the amount just completed.
+ * Otherwise the smallest unused part of the limit is recorded, which
+ * timerAction() gives back.
+ */
+void IntelMausi::intelUpdateTxBQL(UInt32 completed)
+{
+    UInt32 queued = (UInt32)txInflightBytes + completed;
+    UInt32 slack;
 
-    //DebugLog("[IntelMausi]: txInterrupt oldIndex=%u newIndex=%u\n", oldDirtyIndex, txDirtyDescIndex);
+    if (txBQLLimited && !txInflightBytes) {
+        txBQLLimit = min(txBQLLimit + completed, kTxBQLMaxLimit);
+        txBQLStarved = true;
+        drvStats.txBQLStarvations++;
+    } else {
+        slack = (txBQLLimit > queued) ? (txBQLLimit - queued) : 0;
 
-done:
-#ifdef __PRIVATE_SPI__
-    if (txNumFreeDesc > kTxQueueWakeTreshhold)
-        netif->signalOutputThread();
-#else
-    if (stalled && (txNumFreeDesc > kTxQueueWakeTreshhold)) {
-        DebugLog("[IntelMausi]: Restart stalled queue!\n");
-        txQueue->service(IOBasicOutputQueue::kServiceAsync);
-        stalled = false;
+        if (slack < txBQLMinSlack)
+            txBQLMinSlack = slack;
     }
-    etherStats->dot3TxExtraEntry.interrupts++;
-#endif /* __PRIVATE_SPI__ */
+    txBQLLimited = false;
 }
 
-#ifdef __PRIVATE_SPI__
-
-UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+/*
+ * Check if txInterrupt() should run now. Completed packets are released
+ * in large batches once the number of free descriptors drops below the
+ * watermark, the coalescing pool is empty or output is waiting for the
+ * ring. Otherwise they are left to the reclaim timer so that the ring
+ * isn't walked on every interrupt.
+ * The priority ring is small and is cleaned up right away in that case.
+ */
+bool IntelMausi::intelTxReclaimDue()
 {
-    IOPhysicalSegment rxSegment;
-    union e1000_rx_desc_extended *desc;
+    UInt32 completed;
+    bool result = true;
+
+    if (!txReclaimWatermark || (txNumFreeDesc < (SInt32)txReclaimWatermark) || txBQLLimited || (txCoalesceFree <= 0))
+        goto done;
+
+#ifdef __PRIVATE_SPI__
+    if (txPendingPacket)
+        goto done;
+#else
+    if (stalled)
+        goto done;
+#endif /* __PRIVATE_SPI__ */
+
+    if (!txReclaimTimerArmed) {
+        txReclaimTimer->setTimeoutUS(txReclaimTimeout);
+        txReclaimTimerArmed = true;
+    }
+    drvStats.txReclaimDeferrals++;
+    result = false;
+
+    if (txPrioDescArray && (txPrioNumFreeDesc < kNumTxPrioDesc)) {
+        completed = intelTxPrioInterrupt(0);
+
+        if (enableTxBQL && completed)
+            intelUpdateTxBQL(completed);
+    }
+
+done:
+    return result;
+}
+
+/*
+ * Make sure that the tx hang check runs while there are packets in the ring.
+ */
+inline void IntelMausi::intelArmTxHangTimer()
+{
+    if (txHangTimeout && !txHangTimerArmed) {
+        txHangTimerArmed = true;
+        txHangTimer->setTimeoutMS(txHangTimeout / 2);
+    }
+}
+
+/*
+ * Count the packets on the wire for adaptive interrupt throttling when they
+ * are added to a ring. Completion is deferred so that it can't be used for
+ * the classification. The output path doesn't run on the workloop, hence the
+ * atomic updates.
+ */
+inline void IntelMausi::intelItrCountTx(UInt32 packets, UInt32 bytes)
+{
+    if (enableAdaptiveITR) {
+        OSAddAtomic(packets, &itrTxPackets);
+        OSAddAtomic(bytes, &itrTxBytes);
+    }
+}
+
+void IntelMausi::txInterrupt(IOOptionBits options)
+{
+    UInt64 now = mach_absolute_time();
+    UInt32 descStatus;
+    UInt32 completed = 0;
+    UInt32 limit;
+
+    drvStats.txReclaimCalls++;
+
+    if (txPrioDescArray)
+        completed = intelTxPrioInterrupt(options);
+
+    limit = txCleanBarrierIndex;
+
+    while (txDirtyIndex != limit) {
+        /* Only the last descriptor of a packet has numDescs set. */
+        if (txBufArray[txDirtyIndex].numDescs) {
+            descStatus = OSSwapLittleToHostInt32(txDescArray[txDirtyIndex].upper.data);
+
+            if (!(descStatus & E1000_TXD_STAT_DD))
+                goto done;
+
+            completed += intelTxReleasePacket(txDirtyIndex, now, options);
+        }
+        /* Increment txDirtyIndex. */
+        ++txDirtyIndex &= txDescMask;
+    }
+
+    //DebugLog("[IntelMausi]: txInterrupt oldIndex=%u newIndex=%u\n", oldDirtyIndex, txDirtyDescIndex);
+
+done:
+    if (enableTxBQL && completed)
+        intelUpdateTxBQL(completed);
+
+#ifdef __PRIVATE_SPI__
+    if (txNumFreeDesc > kTxQueueWakeTreshhold(numTxDesc))
+        netif->signalOutputThread();
+#else
+    if (stalled && (txNumFreeDesc > kTxQueueWakeTreshhold(numTxDesc)) && ((UInt32)txInflightBytes < txBQLLimit)) {
+        DebugLog("[IntelMausi]: Restart stalled queue!\n");
+        txQueue->service(IOBasicOutputQueue::kServiceAsync);
+        stalled = false;
+    }
+#endif /* __PRIVATE_SPI__ */
+}
+
+/*
+ * Take a mapped buffer from the rx pool. In case the pool ran dry a new
+ * buffer is allocated and mapped.
+ */
+inline bool IntelMausi::intelRxPoolGet(mbuf_t *m, IOPhysicalAddress64 *addr)
+{
+    if (rxPoolCount) {
+        *m = rxPoolArray[rxPoolHead].mbuf;
+        *addr = rxPoolArray[rxPoolHead].phyAddr;
+        rxPoolArray[rxPoolHead].mbuf = NULL;
+
+        ++rxPoolHead &= kRxPoolMask;
+        rxPoolCount--;
+        drvStats.rxPoolHits++;
+
+        return true;
+    }
+    drvStats.rxPoolMisses++;
+
+    return intelRxAllocBuffer(m, addr);
+}
+
+/*
+ * Copy a received packet up to the copybreak size into a new mbuf and leave
+ * the buffer in the ring. Larger packets are handed up with their buffer
+ * which gets replaced by one from the pool. Works like replaceOrCopyPacket()
+ * but with the driver's adaptive threshold. On replacement the physical
+ * address of the new buffer is returned in addr.
+ */
+inline mbuf_t IntelMausi::intelRxCopyOrReplace(mbuf_t *bufPkt, UInt32 pktSize, IOPhysicalAddress64 *addr, bool *replaced)
+{
+    mbuf_t m;
+
+    if (pktSize <= rxCopybreak) {
+        *replaced = false;
+        m = allocatePacket(pktSize);
+
+        if (m) {
+            bcopy(mbuf_data(*bufPkt), mbuf_data(m), pktSize);
+            drvStats.rxCopiedPackets++;
+        }
+    } else {
+        *replaced = true;
+        m = *bufPkt;
+
+        if (intelRxPoolGet(bufPkt, addr))
+            drvStats.rxReplacedPackets++;
+        else
+            m = NULL;
+    }
+    return m;
+}
+
+/*
+ * Adapt the rx copybreak once per timer period. Failed buffer replacements
+ * raise it as copies need small mbufs only. Missed packets show that the
+ * host doesn't keep up so that it is lowered in order to save the copies.
+ */
+void IntelMausi::intelUpdateRxCopybreak()
+{
+    UInt32 errors = etherStats->dot3RxExtraEntry.resourceErrors;
+    UInt64 missed = adapterData.stats.mpc;
+
+    if (!rxCopybreakInit)
+        goto done;
+
+    if (errors != rxCopybreakErrors) {
+        if (rxCopybreak < kRxCopybreakMax) {
+            rxCopybreak = min(rxCopybreak << 1, kRxCopybreakMax);
+            drvStats.rxCopybreakRaises++;
+        }
+    } else if (missed != rxCopybreakMissed) {
+        if (rxCopybreak > kRxCopybreakMin) {
+            rxCopybreak = max(rxCopybreak >> 1, kRxCopybreakMin);
+            drvStats.rxCopybreakCuts++;
+        }
+    }
+
+done:
+    rxCopybreakErrors = errors;
+    rxCopybreakMissed = missed;
+}
+
+/*
+ * Process the packet split descriptor at rxNextDescIndex. The headers are
+ * copied into a new mbuf while the payload pages are handed up and replaced
+ * by new ones. Returns the packet or NULL in case it has been dropped. In
+ * both cases the descriptor is prepared for reuse.
+ */
+mbuf_t IntelMausi::intelRxSplitPacket(UInt32 status, UInt32 *hash)
+{
+    union e1000_rx_desc_packet_split *desc = &rxPSDescArray[rxNextDescIndex];
+    struct intelRxPSBufferInfo *bufInfo = &rxPSBufArray[rxNextDescIndex];
+    IOPhysicalAddress64 newAddr[PS_PAGE_BUFFERS];
+    mbuf_t newPages[PS_PAGE_BUFFERS];
+    mbuf_t pkt = NULL;
+    mbuf_t tail = NULL;
+    mbuf_t m;
+    UInt32 hdrSize = OSSwapLittleToHostInt16(desc->wb.middle.length0);
+    UInt32 pktSize = hdrSize;
+    UInt32 numPages = 0;
+    UInt32 numNew = 0;
+    UInt32 len;
+    UInt32 i;
+    UInt16 vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.middle.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
+
+    *hash = 0;
+
+    while ((numPages < rxPSNumPages) && desc->wb.upper.length[numPages])
+        numPages++;
+
+    /* Skip bad packets. A frame must fit into a single descriptor. */
+    if ((status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) || !(status & E1000_RXD_STAT_EOP) ||
+        (hdrSize > kRxPSHdrBufSize) || (!hdrSize && !numPages)) {
+        DebugLog("[IntelMausi]: Bad packet.\n");
+        etherStats->dot3StatsEntry.internalMacReceiveErrors++;
+        goto nextDesc;
+    }
+    /* Get the replacements first so that nothing changes in case of failure. */
+    for (numNew = 0; numNew < numPages; numNew++) {
+        if (!intelRxPoolGet(&newPages[numNew], &newAddr[numNew]))
+            goto resourceError;
+    }
+    /* Copy the headers as the header buffer stays in the ring. */
+    if (hdrSize) {
+        pkt = allocatePacket(hdrSize);
+
+        if (!pkt)
+            goto resourceError;
+
+        bcopy(&rxPSHdrArray[rxNextDescIndex * kRxPSHdrBufSize], mbuf_data(pkt), hdrSize);
+        mbuf_setlen(pkt, hdrSize);
+        tail = pkt;
+    }
+    /* Hand up the payload pages and put the new ones in their place. */
+    for (i = 0; i < numPages; i++) {
+        m = bufInfo->page[i];
+        len = OSSwapLittleToHostInt16(desc->wb.upper.length[i]);
+        mbuf_setlen(m, len);
+
+        if (tail) {
+            mbuf_setflags_mask(m, 0, MBUF_PKTHDR);
+            mbuf_setnext(tail, m);
+        } else {
+            pkt = m;
+        }
+        tail = m;
+        pktSize += len;
+
+        bufInfo->page[i] = newPages[i];
+        bufInfo->phyAddr[i] = newAddr[i];
+    }
+    *hash = intelGetRssHash(pkt, desc->wb.lower.mrq, desc->wb.lower.hi_dword.rss);
+    intelGetChecksumResult(pkt, status);
+
+    if (vlanTag)
+        setVlanTag(pkt, vlanTag);
+
+    mbuf_pkthdr_setlen(pkt, pktSize);
+    itrRxBytes += pktSize;
+
+    drvStats.rxSplitPackets++;
+    drvStats.rxSplitPages += numPages;
+
+nextDesc:
+    intelRxPSInitDesc(rxNextDescIndex);
+
+    ++rxNextDescIndex &= rxDescMask;
+    rxCleanedCount++;
+
+    return pkt;
+
+resourceError:
+    etherStats->dot3RxExtraEntry.resourceErrors++;
+
+    for (i = 0; i < numNew; i++)
+        intelRxPoolPut(newPages[i], newAddr[i]);
+
+    goto nextDesc;
+}
+
+#ifdef __PRIVATE_SPI__
+
+/* Enqueue a list of received packets linked by their nextpkt pointers. */
+inline void IntelMausi::intelRxInput(IONetworkInterface *interface, IOMbufQueue *pollQueue, mbuf_t m)
+{
+    mbuf_t next;
+
+    for (; m; m = next) {
+        next = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, NULL);
+        interface->enqueueInputPacket(m, pollQueue);
+    }
+}
+
+UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context)
+{
+    union e1000_rx_desc_extended *desc;
     mbuf_t bufPkt, newPkt;
     UInt64 addr;
     UInt32 status;
+    UInt32 hash;
     UInt32 goodPkts = 0;
     UInt32 pktSize;
-    UInt32 n;
     UInt16 vlanTag;
     bool replaced;
 
     if (rxDescArray == NULL)
         return 0;
 
+    if (rxPacketSplit) {
+        while (((status = OSSwapLittleToHostInt32(rxPSDescArray[rxNextDescIndex].wb.middle.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+            if ((newPkt = intelRxSplitPacket(status, &hash))) {
+                if (enableRxLRO)
+                    intelRxInput(interface, pollQueue, intelLroReceive(&rxLro, newPkt, status, hash));
+                else
+                    interface->enqueueInputPacket(newPkt, pollQueue);
+
+                goodPkts++;
+            }
+        }
+        goto updateTail;
+    }
     desc = &rxDescArray[rxNextDescIndex];
 
     while (((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
@@ -1735,11 +2115,11 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
             discardPacketFragment(true);
             goto nextDesc;
         }
-        newPkt = replaceOrCopyPacket(&bufPkt, pktSize, &replaced);
+        newPkt = intelRxCopyOrReplace(&bufPkt, pktSize, &addr, &replaced);
 
         if (!newPkt) {
             /* Allocation of a new packet failed so that we must leave the original packet in place. */
-            //DebugLog("[IntelMausi]: replaceOrCopyPacket() failed.\n");
+            //DebugLog("[IntelMausi]: intelRxCopyOrReplace() failed.\n");
             etherStats->dot3RxExtraEntry.resourceErrors++;
             discardPacketFragment(true);
             goto nextDesc;
@@ -1747,16 +2127,6 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
 
         /* If the packet was replaced we have to update the descriptor's buffer address. */
         if (replaced) {
-            n = rxMbufCursor->getPhysicalSegments(bufPkt, &rxSegment, 1);
-
-            if ((n != 1) || (rxSegment.location & 0x07ff)) {
-                DebugLog("[IntelMausi]: getPhysicalSegments() failed.\n");
-                etherStats->dot3RxExtraEntry.resourceErrors++;
-                freePacketEx(bufPkt);
-                discardPacketFragment(true);
-                goto nextDesc;
-            }
-            addr = rxSegment.location;
             rxBufArray[rxNextDescIndex].mbuf = bufPkt;
             rxBufArray[rxNextDescIndex].phyAddr = addr;
         }
@@ -1779,6 +2149,7 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
                 rxPacketHead = newPkt;
                 rxPacketSize = pktSize;
             }
+            hash = intelGetRssHash(rxPacketHead, desc->wb.lower.mrq, desc->wb.lower.hi_dword.rss);
             intelGetChecksumResult(rxPacketHead, status);
 
             /* Also get the VLAN tag if there is any. */
@@ -1786,7 +2157,12 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
                 setVlanTag(rxPacketHead, vlanTag);
 
             mbuf_pkthdr_setlen(rxPacketHead, rxPacketSize);
-            interface->enqueueInputPacket(rxPacketHead, pollQueue);
+            itrRxBytes += rxPacketSize;
+
+            if (enableRxLRO)
+                intelRxInput(interface, pollQueue, intelLroReceive(&rxLro, rxPacketHead, status, hash));
+            else
+                interface->enqueueInputPacket(rxPacketHead, pollQueue);
 
             rxPacketHead = rxPacketTail = NULL;
             rxPacketSize = 0;
@@ -1812,98 +2188,182 @@ UInt32 IntelMausi::rxInterrupt(IONetworkInterface *interface, uint32_t maxCount,
         desc->read.buffer_addr = OSSwapHostToLittleInt64(addr);
         desc->read.reserved = 0;
 
-        ++rxNextDescIndex &= kRxDescMask;
+        ++rxNextDescIndex &= rxDescMask;
         desc = &rxDescArray[rxNextDescIndex];
         rxCleanedCount++;
     }
+
+updateTail:
+    itrRxPackets += goodPkts;
+
+    /* Hand up the coalesced flows at the end of each run. */
+    if (enableRxLRO)
+        intelRxInput(interface, pollQueue, intelLroFlushAll(&rxLro));
+
     if (rxCleanedCount >= E1000_RX_BUFFER_WRITE) {
         /*
          * Prevent the tail from reaching the head in order to avoid a false
          * buffer queue full condition.
          */
         if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-            intelUpdateRxDescTail((rxNextDescIndex - 1) & kRxDescMask);
+            intelUpdateRxDescTail((rxNextDescIndex - 1) & rxDescMask);
         else
-            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & kRxDescMask);
+            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & rxDescMask);
 
         rxCleanedCount = 0;
     }
+    /* Replace the buffers which have been taken from the pool. */
+    if (rxPoolCount < kRxPoolSize)
+        intelRxPoolRefill(kRxPoolRefillBatch);
+
     return goodPkts;
 }
 
 #else
 
-void IntelMausi::rxInterrupt()
+/* Enqueue a list of received packets linked by their nextpkt pointers. */
+inline void IntelMausi::intelRxInput(mbuf_t m)
+{
+    mbuf_t next;
+
+    for (; m; m = next) {
+        next = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, NULL);
+        netif->inputPacket(m, 0, IONetworkInterface::kInputOptionQueuePacket);
+    }
+}
+
+UInt32 IntelMausi::rxInterrupt(UInt32 maxCount)
 {
-    IOPhysicalSegment rxSegment;
     union e1000_rx_desc_extended *desc = &rxDescArray[rxNextDescIndex];
     mbuf_t bufPkt, newPkt;
     UInt64 addr;
     UInt32 status;
+    UInt32 hash;
     UInt32 goodPkts = 0;
     UInt32 crcSize = (adapterData.flags2 & FLAG2_CRC_STRIPPING) ? 0 : kIOEthernetCRCSize;
     UInt32 pktSize;
     UInt16 vlanTag;
     bool replaced;
 
-    while ((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) {
-        addr = rxBufArray[rxNextDescIndex].phyAddr;
-        bufPkt = rxBufArray[rxNextDescIndex].mbuf;
+    if (rxPacketSplit) {
+        while (((status = OSSwapLittleToHostInt32(rxPSDescArray[rxNextDescIndex].wb.middle.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+            if ((newPkt = intelRxSplitPacket(status, &hash))) {
+                if (enableRxLRO)
+                    intelRxInput(intelLroReceive(&rxLro, newPkt, status, hash));
+                else
+                    netif->inputPacket(newPkt, 0, IONetworkInterface::kInputOptionQueuePacket);
 
-        /* As we don't support jumbo frames we consider fragmented packets as errors. */
-        if (!(status & E1000_RXD_STAT_EOP)) {
-            DebugLog("[IntelMausi]: Fragmented packet.\n");
-            etherStats->dot3StatsEntry.frameTooLongs++;
-            goto nextDesc;
+                goodPkts++;
+            }
         }
-        pktSize = OSSwapLittleToHostInt16(desc->wb.upper.length) - crcSize;
+        goto updateTail;
+    }
+
+    while (((status = OSSwapLittleToHostInt32(desc->wb.upper.status_error)) & E1000_RXD_STAT_DD) && (goodPkts < maxCount)) {
+        addr = rxBufArray[rxNextDescIndex].phyAddr;
+        bufPkt = rxBufArray[rxNextDescIndex].mbuf;
+        pktSize = OSSwapLittleToHostInt16(desc->wb.upper.length);
         vlanTag = (status & E1000_RXD_STAT_VP) ? (OSSwapLittleToHostInt16(desc->wb.upper.vlan) & E1000_RXD_SPC_VLAN_MASK) : 0;
 
         /* Skip bad packet. */
         if (status & E1000_RXDEXT_ERR_FRAME_ERR_MASK) {
             DebugLog("[IntelMausi]: Bad packet.\n");
             etherStats->dot3StatsEntry.internalMacReceiveErrors++;
+            discardPacketFragment();
             goto nextDesc;
         }
-        newPkt = replaceOrCopyPacket(&bufPkt, pktSize, &replaced);
+        newPkt = intelRxCopyOrReplace(&bufPkt, pktSize, &addr, &replaced);
 
         if (!newPkt) {
             /* Allocation of a new packet failed so that we must leave the original packet in place. */
-            //DebugLog("[IntelMausi]: replaceOrCopyPacket() failed.\n");
+            //DebugLog("[IntelMausi]: intelRxCopyOrReplace() failed.\n");
             etherStats->dot3RxExtraEntry.resourceErrors++;
+            discardPacketFragment();
             goto nextDesc;
         }
 
         /* If the packet was replaced we have to update the descriptor's buffer address. */
         if (replaced) {
-            if (rxMbufCursor->getPhysicalSegments(bufPkt, &rxSegment, 1) != 1) {
-                DebugLog("[IntelMausi]: getPhysicalSegments() failed.\n");
-                etherStats->dot3RxExtraEntry.resourceErrors++;
-                freePacket(bufPkt);
-                goto nextDesc;
-            }
-            addr = rxSegment.location;
             rxBufArray[rxNextDescIndex].mbuf = bufPkt;
             rxBufArray[rxNextDescIndex].phyAddr = addr;
         }
-        intelGetChecksumResult(newPkt, status);
+        /* Set the length of the buffer. */
+        mbuf_setlen(newPkt, pktSize);
+
+        if (status & E1000_RXD_STAT_EOP) {
+            if (rxPacketHead) {
+                /* This is the last buffer of a jumbo frame. */
+                mbuf_setflags_mask(newPkt, 0, MBUF_PKTHDR);
+                mbuf_setnext(rxPacketTail, newPkt);
+
+                /* The CRC might have been split across the last two buffers. */
+                if (pktSize < crcSize) {
+                    mbuf_setlen(rxPacketTail, mbuf_len(rxPacketTail) - (crcSize - pktSize));
+                    rxPacketSize -= (crcSize - pktSize);
+                    mbuf_setlen(newPkt, 0);
+                } else {
+                    mbuf_setlen(newPkt, pktSize - crcSize);
+                    rxPacketSize += (pktSize - crcSize);
+                }
+                rxPacketTail = newPkt;
+            } else {
+                /* We've got a complete packet in one buffer. */
+                mbuf_setlen(newPkt, pktSize - crcSize);
+                rxPacketHead = newPkt;
+                rxPacketSize = pktSize - crcSize;
+            }
+            /* Checksum results, RSS hash and VLAN tag are valid in the last descriptor only. */
+            hash = intelGetRssHash(rxPacketHead, desc->wb.lower.mrq, desc->wb.lower.hi_dword.rss);
+            intelGetChecksumResult(rxPacketHead, status);
+
+            if (vlanTag)
+                setVlanTag(rxPacketHead, vlanTag);
+
+            mbuf_pkthdr_setlen(rxPacketHead, rxPacketSize);
+            itrRxBytes += rxPacketSize;
+
+            if (enableRxLRO)
+                intelRxInput(intelLroReceive(&rxLro, rxPacketHead, status, hash));
+            else
+                netif->inputPacket(rxPacketHead, 0, IONetworkInterface::kInputOptionQueuePacket);
 
-        /* Also get the VLAN tag if there is any. */
-        if (vlanTag)
-            setVlanTag(newPkt, vlanTag);
+            rxPacketHead = rxPacketTail = NULL;
+            rxPacketSize = 0;
+
+            goodPkts++;
+        } else {
+            if (rxPacketHead) {
+                /* We are in the middle of a jumbo frame. */
+                mbuf_setflags_mask(newPkt, 0, MBUF_PKTHDR);
+                mbuf_setnext(rxPacketTail, newPkt);
 
-        netif->inputPacket(newPkt, pktSize, IONetworkInterface::kInputOptionQueuePacket);
-        goodPkts++;
+                rxPacketTail = newPkt;
+                rxPacketSize += pktSize;
+            } else {
+                /* This is the first buffer of a jumbo frame. */
+                rxPacketHead = rxPacketTail = newPkt;
+                rxPacketSize = pktSize;
+            }
+        }
 
         /* Finally update the descriptor and get the next one to examine. */
     nextDesc:
         desc->read.buffer_addr = OSSwapHostToLittleInt64(addr);
         desc->read.reserved = 0;
 
-        ++rxNextDescIndex &= kRxDescMask;
+        ++rxNextDescIndex &= rxDescMask;
         desc = &rxDescArray[rxNextDescIndex];
         rxCleanedCount++;
     }
+
+updateTail:
+    itrRxPackets += goodPkts;
+
+    /* Hand up the coalesced flows at the end of each run. */
+    if (enableRxLRO)
+        intelRxInput(intelLroFlushAll(&rxLro));
+
     if (goodPkts)
         netif->flushInputQueue();
 
@@ -1913,17 +2373,52 @@ void IntelMausi::rxInterrupt()
          * buffer queue full condition.
          */
         if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-            intelUpdateRxDescTail((rxNextDescIndex - 1) & kRxDescMask);
+            intelUpdateRxDescTail((rxNextDescIndex - 1) & rxDescMask);
         else
-            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & kRxDescMask);
+            intelWriteMem32(E1000_RDT(0), (rxNextDescIndex - 1) & rxDescMask);
 
         rxCleanedCount = 0;
     }
+    /* Replace the buffers which have been taken from the pool. */
+    if (rxPoolCount < kRxPoolSize)
+        intelRxPoolRefill(kRxPoolRefillBatch);
+
     etherStats->dot3RxExtraEntry.interrupts++;
+
+    return goodPkts;
 }
 
 #endif /* __PRIVATE_SPI__ */
 
+/* Check if the next rx descriptor has been written back. */
+inline bool IntelMausi::intelRxPending()
+{
+    UInt32 status;
+
+    if (rxPacketSplit)
+        status = OSSwapLittleToHostInt32(rxPSDescArray[rxNextDescIndex].wb.middle.status_error);
+    else
+        status = OSSwapLittleToHostInt32(rxDescArray[rxNextDescIndex].wb.upper.status_error);
+
+    return (status & E1000_RXD_STAT_DD);
+}
+
+/*
+ * Called after a budgeted rx run. In case there are packets left in the
+ * ring, the rx interrupts stay masked and another run is scheduled.
+ */
+bool IntelMausi::intelRxBudgetExceeded()
+{
+    if (!intelRxPending())
+        return false;
+
+    rxBudgetPending = true;
+    drvStats.rxBudgetHits++;
+    rxBudgetSource->interruptOccurred(NULL, NULL, 0);
+
+    return true;
+}
+
 void IntelMausi::checkLinkStatus()
 {
     struct e1000_hw *hw = &adapterData.hw;
@@ -1975,31 +2470,46 @@ void IntelMausi::interruptOccurred(OSObject *client, IOInterruptEventSource *src
     struct e1000_hw *hw = &adapterData.hw;
     UInt32 icr = intelReadMem32(E1000_ICR); /* read ICR disables interrupts using IAM */
 
+    /* Leave the rx interrupts masked while a deferred run is pending. */
+    if (rxBudgetPending)
+        icr &= ~kIntelRxIntrMask;
+
 #ifdef __PRIVATE_SPI__
     UInt32 packets;
 
     if (!polling) {
         if (icr & (E1000_ICR_TXDW | E1000_ICR_TXQ0)) {
-            txInterrupt();
+            if (intelTxReclaimDue())
+                txInterrupt();
+
             etherStats->dot3TxExtraEntry.interrupts++;
         }
 
-        if (icr & (E1000_ICR_RXQ0 | E1000_ICR_RXT0 | E1000_ICR_RXDMT0)) {
-            packets = rxInterrupt(netif, kNumRxDesc, NULL, NULL);
+        if (icr & kIntelRxIntrMask) {
+            packets = rxInterrupt(netif, rxBudget, NULL, NULL);
             etherStats->dot3RxExtraEntry.interrupts++;
 
             if (packets)
                 netif->flushInputQueue();
+
+            if (intelRxBudgetExceeded())
+                icr &= ~kIntelRxIntrMask;
         }
     }
 #else
     /* Handle transmit descriptors. */
     if (icr & (E1000_ICR_TXDW | E1000_ICR_TXQ0)) {
-        txInterrupt();
+        if (intelTxReclaimDue())
+            txInterrupt();
+
+        etherStats->dot3TxExtraEntry.interrupts++;
     }
     /* Handle receive descriptors. */
-    if (icr & (E1000_ICR_RXQ0 | E1000_ICR_RXT0 | E1000_ICR_RXDMT0)) {
-        rxInterrupt();
+    if (icr & kIntelRxIntrMask) {
+        rxInterrupt(rxBudget);
+
+        if (intelRxBudgetExceeded())
+            icr &= ~kIntelRxIntrMask;
     }
 #endif /* __PRIVATE_SPI__ */
 
@@ -2017,10 +2527,48 @@ void IntelMausi::interruptOccurred(OSObject *client, IOInterruptEventSource *src
     if (icr & (E1000_ICR_LSC | E1000_IMS_RXSEQ)) {
         checkLinkStatus();
     }
+    if (enableAdaptiveITR)
+        intelUpdateITR();
+
     /* Reenable interrupts by setting the bits in the mask register. */
     intelWriteMem32(E1000_IMS, icr);
 }
 
+/*
+ * Continue receiving where the last budgeted run stopped and unmask the
+ * rx interrupts once the ring has been drained.
+ */
+void IntelMausi::rxBudgetAction(OSObject *client, IOInterruptEventSource *src, int count)
+{
+#ifdef __PRIVATE_SPI__
+    UInt32 packets;
+#endif /* __PRIVATE_SPI__ */
+
+    rxBudgetPending = false;
+
+    if (!isEnabled)
+        goto done;
+
+#ifdef __PRIVATE_SPI__
+    /* Polling mode has taken over the ring. */
+    if (polling)
+        goto done;
+
+    packets = rxInterrupt(netif, rxBudget, NULL, NULL);
+
+    if (packets)
+        netif->flushInputQueue();
+#else
+    rxInterrupt(rxBudget);
+#endif /* __PRIVATE_SPI__ */
+
+    if (!intelRxBudgetExceeded())
+        intelWriteMem32(E1000_IMS, (E1000_IMS_RXT0 | E1000_IMS_RXDMT0));
+
+done:
+    return;
+}
+
 #pragma mark --- rx poll methods ---
 
 #ifdef __PRIVATE_SPI__
@@ -2036,6 +2584,11 @@ IOReturn IntelMausi::setInputPacketPollingEnable(IONetworkInterface *interface,
         } else {
             intelEnableIRQ(&adapterData);
         }
+        if (polling != enabled) {
+            intelPollAccountTime();
+            OSIncrementAtomic(&pollSwitchesPeriod);
+            drvStats.pollModeSwitches++;
+        }
         polling = enabled;
     }
     //DebugLog("[IntelMausi]: input polling %s.\n", enabled ? "enabled" : "disabled");
@@ -2047,18 +2600,121 @@ IOReturn IntelMausi::setInputPacketPollingEnable(IONetworkInterface *interface,
 
 void IntelMausi::pollInputPackets(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context )
 {
+    UInt32 packets;
+
     //DebugLog("[IntelMausi]: pollInputPackets() ===>\n");
 
     if (polling) {
-        rxInterrupt(interface, maxCount, pollQueue, context);
+        packets = rxInterrupt(interface, maxCount, pollQueue, context);
+
+        OSIncrementAtomic(&pollCallsPeriod);
+        OSAddAtomic(packets, &pollPacketsPeriod);
+        drvStats.pollCalls++;
+        drvStats.pollPackets += packets;
+
+        if (!packets)
+            drvStats.pollEmpty++;
 
         /* Finally cleanup the transmitter ring. */
-        txInterrupt();
+        if (intelTxReclaimDue())
+            txInterrupt();
     }
 
     //DebugLog("[IntelMausi]: pollInputPackets() <===\n");
 }
 
+/*
+ * Add the time since the last mode change to the current mode. The poller
+ * thread and the workloop both get here, so the interval is claimed with a
+ * compare and swap in order to account it exactly once.
+ */
+void IntelMausi::intelPollAccountTime()
+{
+    UInt64 now = mach_absolute_time();
+    UInt64 start;
+    UInt64 elapsed;
+
+    do {
+        start = pollModeStart;
+
+        if (now <= start)
+            return;
+    } while (!OSCompareAndSwap64(start, now, &pollModeStart));
+
+    elapsed = now - start;
+
+    if (polling) {
+        drvStats.pollTime += elapsed;
+        OSAddAtomic64(elapsed, &pollTimePeriod);
+    } else {
+        drvStats.intrTime += elapsed;
+    }
+}
+
+/*
+ * Tune the polling parameters once per timer period. The poller thread
+ * updates the period counters without the workloop lock using atomic
+ * operations. They are read once and only the values read are subtracted
+ * afterwards, so that updates in between are kept for the next period.
+ */
+void IntelMausi::intelTunePollParams()
+{
+    UInt64 interval = pollParams.pollIntervalTime;
+    UInt64 ns;
+    SInt64 time;
+    SInt32 calls;
+    SInt32 packets;
+    SInt32 switches;
+    UInt32 scale = pollThresholdScale;
+
+    intelPollAccountTime();
+
+    time = pollTimePeriod;
+    calls = pollCallsPeriod;
+    packets = pollPacketsPeriod;
+    switches = pollSwitchesPeriod;
+
+    OSAddAtomic64(-time, &pollTimePeriod);
+    OSAddAtomic(-calls, &pollCallsPeriod);
+    OSAddAtomic(-packets, &pollPacketsPeriod);
+    OSAddAtomic(-switches, &pollSwitchesPeriod);
+
+    /* Aim at kPollTargetYield packets per poll at the arrival rate seen while polling. */
+    if (calls && time) {
+        absolutetime_to_nanoseconds(time, &ns);
+
+        if (packets)
+            interval = (interval + (ns * kPollTargetYield / packets)) >> 1;
+        else
+            interval <<= 1;
+
+        if (interval < kPollIntervalMin)
+            interval = kPollIntervalMin;
+        else if (interval > kPollIntervalMax)
+            interval = kPollIntervalMax;
+    }
+    /* Widen the hysteresis in case the mode keeps flapping. */
+    if ((switches > kPollSwitchesMax) && (scale < kPollThresholdScaleMax))
+        scale <<= 1;
+    else if (!switches && (scale > 1))
+        scale >>= 1;
+
+    if ((interval == pollParams.pollIntervalTime) && (scale == pollThresholdScale))
+        return;
+
+    pollThresholdScale = scale;
+    pollParams.pollIntervalTime = interval;
+    pollParams.lowThresholdPackets = pollBaseParams.lowThresholdPackets * scale;
+    pollParams.highThresholdPackets = pollBaseParams.highThresholdPackets * scale;
+    pollParams.lowThresholdBytes = pollBaseParams.lowThresholdBytes * scale;
+    pollParams.highThresholdBytes = pollBaseParams.highThresholdBytes * scale;
+
+#if __MAC_OS_X_VERSION_MIN_REQUIRED >= __MAC_10_9
+    netif->setPacketPollingParameters(&pollParams, 0);
+    drvStats.pollParamUpdates++;
+#endif
+}
+
 #endif /* __PRIVATE_SPI__ */
 
 #pragma mark --- hardware specific methods ---
@@ -2132,7 +2788,7 @@ void IntelMausi::setLinkUp()
         duplexName = duplexFullName;
         adapterData.rx_int_delay = rxDelayTime1000;
         adapterData.rx_abs_int_delay = rxAbsTime1000;
-        rate = intrThrValue1000;
+        rate = (enableAdaptiveITR) ? intelResetITR() : intrThrValue1000;
 
         eeeMode = intelSupportsEEE(&adapterData);
 
@@ -2197,6 +2853,9 @@ void IntelMausi::setLinkUp()
             duplexName = duplexHalfName;
         }
     }
+    /* TSO is unreliable at 10/100 so that it's done in software. */
+    forceGSO = (adapterData.link_speed != SPEED_1000);
+
     /* Update the Receive Delay Timer Register */
     intelWriteMem32(E1000_RDTR, adapterData.rx_int_delay);
 
@@ -2245,6 +2904,12 @@ void IntelMausi::setLinkUp()
         pollParams.highThresholdBytes = 0x10000;
         pollParams.pollIntervalTime = (adapterData.link_speed == SPEED_1000) ? 170000 : 1000000;  /* 170µs / 1ms */
     }
+    /* Start tuning from the defaults of the link speed. */
+    pollBaseParams = pollParams;
+    pollThresholdScale = 1;
+    pollCallsPeriod = pollPacketsPeriod = pollSwitchesPeriod = 0;
+    pollTimePeriod = 0;
+    pollModeStart = mach_absolute_time();
 
 #if __MAC_OS_X_VERSION_MIN_REQUIRED >= __MAC_10_9
     netif->setPacketPollingParameters(&pollParams, 0);
@@ -2331,6 +2996,33 @@ void IntelMausi::setLinkDown()
     DebugLog("[IntelMausi]: Link down on en%u\n", netif->getUnitNumber());
 }
 
+/*
+ * Get the RSS hash which the hardware has computed for a received packet.
+ * Returns 0 in case there is none. The mbuf KPI offers no way to hand the
+ * hash to the network stack, so it is only used to look up flows for
+ * receive coalescing and for the statistics.
+ */
+inline UInt32 IntelMausi::intelGetRssHash(mbuf_t m, UInt32 mrq, UInt32 rss)
+{
+    UInt32 type = OSSwapLittleToHostInt32(mrq) & kRxRssTypeMask;
+    UInt32 hash = 0;
+
+    if (type != kRxRssTypeNone) {
+        hash = OSSwapLittleToHostInt32(rss);
+
+        if ((type == kRxRssTypeTCPIPv4) || (type == kRxRssTypeTCPIPv6))
+            drvStats.rxHashL4Packets++;
+        else
+            drvStats.rxHashL3Packets++;
+
+#ifdef DEBUG
+        if (type == kRxRssTypeTCPIPv4)
+            intelVerifyRssHash(m, hash);
+#endif
+    }
+    return hash;
+}
+
 inline void IntelMausi::intelGetChecksumResult(mbuf_t m, UInt32 status)
 {
     if (!(status & (E1000_RXDEXT_STATERR_IPE | E1000_RXDEXT_STATERR_TCPE))) {
@@ -2396,7 +3088,7 @@ bool IntelMausi::intelStart()
     bool result = false;
 
     /* Setup some default values. */
-    adapterData.rx_buffer_len = kRxBufferPktSize;
+    adapterData.rx_buffer_len = rxBufferSize;
     adapterData.max_frame_size = mtu + ETH_HLEN + ETH_FCS_LEN;
     adapterData.min_frame_size = ETH_ZLEN + ETH_FCS_LEN;
 
@@ -2568,8 +3260,737 @@ error_eeprom:
 
     goto done;
 }
+#pragma mark --- tx offload methods ---
+
+/*
+ * Fill in the descriptors of a packet using the given offload parameters.
+ * The ring is given by its descriptors, buffer info, next index, free
+ * descriptor count, index mask and offload context so that the default
+ * and the priority ring share this code. The caller must make sure that
+ * there are at least numSegs + 1 free descriptors. Returns the number of
+ * descriptors used.
+ */
+UInt32 IntelMausi::intelTxFillDescs(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, UInt16 *nextIndex, SInt32 *numFreeDesc,
+                                    UInt32 mask, struct intelTxContext *context, mbuf_t m, IOPhysicalSegment *segs, UInt32 numSegs,
+                                    const struct intelTxOffload *offload)
+{
+    UInt32 opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
+    UInt32 word2 = offload->word2;
+    UInt32 index = *nextIndex;
+    UInt32 bytes = (UInt32)mbuf_pkthdr_len(m);
+    UInt32 numDescs;
+    UInt32 wireSegs;
+    UInt32 mss;
+    UInt16 vlanTag;
+
+    /* Get the VLAN tag and command bit. */
+    if (!mbuf_get_vlan_tag(m, &vlanTag)) {
+        opts |= E1000_TXD_CMD_VLE;
+        word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+    }
+    numDescs = intelTxWriteDescs(descArray, bufArray, index, mask, context, segs, numSegs, offload, opts, word2, m);
+
+    if (offload->cmdLen && (numDescs == numSegs))
+        drvStats.txContextsSaved++;
+
+    index = (index + numDescs - 1) & mask;
+    bufArray[index].bytes = bytes;
+    bufArray[index].time = mach_absolute_time();
+
+    /* Packets of both rings count against the byte queue limit. */
+    OSAddAtomic(-numDescs, numFreeDesc);
+    OSAddAtomic(bytes, &txInflightBytes);
+    *nextIndex = (index + 1) & mask;
+
+    /* A TSO packet goes out as several segments, each with its own headers. */
+    if (offload->cmd & E1000_TXD_CMD_TSE) {
+        mss = offload->segSetup >> 16;
+        wireSegs = ((offload->cmdLen & 0x000fffff) + mss - 1) / mss;
+        intelItrCountTx(wireSegs, bytes + (wireSegs - 1) * ((offload->segSetup >> 8) & 0xff));
+    } else {
+        intelItrCountTx(1, bytes);
+    }
+    return numDescs;
+}
+
+/*
+ * Send a small packet from the bounce buffer slot of its first descriptor
+ * which saves the segment lookup. The mbuf is released immediately.
+ * Returns false in case the packet couldn't be copied and must be dropped.
+ */
+bool IntelMausi::intelTransmitCopy(mbuf_t m, UInt32 pktLen, const struct intelTxOffload *offload)
+{
+    IOPhysicalSegment seg;
+    UInt32 offset = txNextDescIndex * kTxBounceSlotSize;
+    bool result = false;
+
+    if (mbuf_copydata(m, 0, pktLen, &txBounceArray[offset])) {
+        DebugLog("[IntelMausi]: mbuf_copydata() failed. Dropping packet.\n");
+        etherStats->dot3TxExtraEntry.resourceErrors++;
+        goto done;
+    }
+    seg.location = txBouncePhyAddr + offset;
+    seg.length = pktLen;
+
+    intelTxFillDescs(txDescArray, txBufArray, &txNextDescIndex, &txNumFreeDesc, txDescMask, &txContext, m, &seg, 1, offload);
+    intelTxDetachMbuf(m, false);
+
+    drvStats.txCopybreakPackets++;
+    result = true;
+
+done:
+    return result;
+}
+
+/*
+ * Get the physical segments of a packet. A packet with more than kMaxSegs
+ * fragments is copied into the next buffer of the coalescing pool instead
+ * of a newly allocated mbuf. The buffer is claimed by intelTxDetachMbuf()
+ * once the packet has been added to the ring. Returns kIOReturnNoResources
+ * in case the packet has to wait for a buffer and kIOReturnError in case
+ * it must be dropped.
+ */
+IOReturn IntelMausi::intelTxGetSegments(mbuf_t m, IOPhysicalSegment *segs, UInt32 *numSegs, bool *coalesced)
+{
+    IOReturn result = kIOReturnSuccess;
+    UInt32 pktLen;
+    UInt32 offset;
+
+    *coalesced = false;
+    *numSegs = txMbufCursor->getPhysicalSegments(m, segs, kMaxSegs);
+
+    if (*numSegs)
+        goto done;
+
+    pktLen = (UInt32)mbuf_pkthdr_len(m);
+
+    if (pktLen <= kTxCoalesceBufSize) {
+        if (txCoalesceFree <= 0) {
+            drvStats.txCoalesceStalls++;
+            result = kIOReturnNoResources;
+            goto done;
+        }
+        offset = kTxCoalesceOffset(numTxDesc) + txCoalesceNext * kTxCoalesceBufSize;
+
+        if (mbuf_copydata(m, 0, pktLen, &txBounceArray[offset])) {
+            DebugLog("[IntelMausi]: mbuf_copydata() failed. Dropping packet.\n");
+            etherStats->dot3TxExtraEntry.resourceErrors++;
+            result = kIOReturnError;
+            goto done;
+        }
+        segs[0].location = txBouncePhyAddr + offset;
+        segs[0].length = pktLen;
+        *numSegs = 1;
+        *coalesced = true;
+    } else {
+        /* Packets too large for the pool need a new mbuf. */
+        *numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, segs, kMaxSegs);
+
+        if (!*numSegs) {
+            DebugLog("[IntelMausi]: getPhysicalSegmentsWithCoalesce() failed. Dropping packet.\n");
+            etherStats->dot3TxExtraEntry.resourceErrors++;
+            result = kIOReturnError;
+        }
+    }
+
+done:
+    return result;
+}
+
+/*
+ * Release the mbuf of a packet which has just been added to the ring after
+ * its data has been copied into a driver owned buffer.
+ */
+void IntelMausi::intelTxDetachMbuf(mbuf_t m, bool coalesced)
+{
+    UInt32 index = (txNextDescIndex - 1) & txDescMask;
+
+    txBufArray[index].mbuf = NULL;
+
+    if (coalesced) {
+        txBufArray[index].coalesced = true;
+        ++txCoalesceNext &= kTxCoalesceMask;
+        OSDecrementAtomic(&txCoalesceFree);
+        drvStats.txCoalescedPackets++;
+    }
+    freePacket(m);
+}
+
+#ifdef __PRIVATE_SPI__
+
+/*
+ * Check if a packet should be sent on the priority ring. The stack's
+ * service class tells us which packets are latency sensitive.
+ */
+bool IntelMausi::intelIsPrioPacket(mbuf_t m)
+{
+    UInt32 tsoFlags;
+    UInt32 tsoMss;
+    bool result = false;
+
+    /* TSO packets are left to the default ring. */
+    if (!mbuf_get_tso_requested(m, &tsoFlags, &tsoMss) && tsoFlags)
+        goto done;
+
+    switch (mbuf_get_service_class(m)) {
+        case MBUF_SC_OAM:
+        case MBUF_SC_SIG:
+        case MBUF_SC_VO:
+        case MBUF_SC_CTL:
+            result = true;
+            break;
+
+        default:
+            break;
+    }
+
+done:
+    return result;
+}
+
+#else
+
+/*
+ * Check if a packet should be sent on the priority ring. Without the
+ * service class we have to rely on the VLAN priority and the DSCP.
+ */
+bool IntelMausi::intelIsPrioPacket(mbuf_t m)
+{
+    UInt8 hdr[ETH_HLEN + 2];
+    UInt32 tsoFlags;
+    UInt32 tsoMss;
+    UInt32 dscp;
+    UInt16 vlanTag;
+    bool result = false;
+
+    /* TSO packets are left to the default ring. */
+    if (!mbuf_get_tso_requested(m, &tsoFlags, &tsoMss) && tsoFlags)
+        goto done;
+
+    if (!mbuf_get_vlan_tag(m, &vlanTag) && ((vlanTag >> 13) >= kTxPrioMinPCP)) {
+        result = true;
+        goto done;
+    }
+    if (mbuf_copydata(m, 0, sizeof(hdr), hdr))
+        goto done;
+
+    switch ((hdr[12] << 8) | hdr[13]) {
+        case ETH_P_IP:
+            dscp = hdr[ETH_HLEN + 1] >> 2;
+            break;
+
+        case ETH_P_IPV6:
+            dscp = ((hdr[ETH_HLEN] & 0x0f) << 2) | (hdr[ETH_HLEN + 1] >> 6);
+            break;
+
+        default:
+            goto done;
+    }
+    result = (dscp >= kTxPrioMinDSCP);
+
+done:
+    return result;
+}
+
+#endif /* __PRIVATE_SPI__ */
+
+/*
+ * Send a packet on the priority ring. As the ring only carries a few
+ * latency sensitive packets, they are mapped directly. The caller makes
+ * them visible to the hardware with intelFlushTxPrio(). Returns false in
+ * case the packet has to be sent on the default ring because the priority
+ * ring is full or the packet has too many fragments.
+ */
+bool IntelMausi::intelTransmitPrio(mbuf_t m)
+{
+    IOPhysicalSegment segs[kMaxSegs];
+    UInt32 offloadFlags = 0;
+    UInt32 csumData = 0;
+    UInt32 numSegs;
+    bool result = false;
+
+    numSegs = txMbufCursor->getPhysicalSegments(m, segs, kMaxSegs);
+
+    if (!numSegs || (txPrioNumFreeDesc <= (SInt32)(numSegs + 1))) {
+        drvStats.txPrioFallbacks++;
+        goto done;
+    }
+    mbuf_get_csum_requested(m, &offloadFlags, &csumData);
+
+    /*
+     * Each queue has its own offload context. Priority packets aren't held
+     * back by the byte queue limit, but they count against it.
+     */
+    intelTxFillDescs(txPrioDescArray, txPrioBufArray, &txPrioNextDescIndex, &txPrioNumFreeDesc, kTxPrioDescMask, &txPrioContext,
+                     m, segs, numSegs, getTxOffload(offloadFlags));
+
+    drvStats.txPrioPackets++;
+    result = true;
+
+done:
+    return result;
+}
+
+/*
+ * Update the priority ring's tail register after one or more packets have
+ * been added by intelTransmitPrio().
+ */
+void IntelMausi::intelFlushTxPrio()
+{
+    intelWriteMem32(E1000_TDT(1), txPrioNextDescIndex);
+    txPrioCleanBarrierIndex = txPrioNextDescIndex;
+    intelArmTxHangTimer();
+
+    drvStats.txPrioDoorbells++;
+}
+
+/*
+ * Release the completed packets of the priority ring. Returns the number
+ * of bytes completed.
+ */
+UInt32 IntelMausi::intelTxPrioInterrupt(IOOptionBits options)
+{
+    UInt32 descStatus;
+    UInt32 limit = txPrioCleanBarrierIndex;
+    UInt32 completed = 0;
+    UInt32 bytes;
+    SInt32 cleaned;
+
+    while (txPrioDirtyIndex != limit) {
+        if (txPrioBufArray[txPrioDirtyIndex].numDescs) {
+            descStatus = OSSwapLittleToHostInt32(txPrioDescArray[txPrioDirtyIndex].upper.data);
+
+            if (!(descStatus & E1000_TXD_STAT_DD))
+                break;
+
+            freePacketEx(txPrioBufArray[txPrioDirtyIndex].mbuf, options);
+            txPrioBufArray[txPrioDirtyIndex].mbuf = NULL;
+
+            cleaned = txPrioBufArray[txPrioDirtyIndex].numDescs;
+            bytes = txPrioBufArray[txPrioDirtyIndex].bytes;
+            txPrioBufArray[txPrioDirtyIndex].numDescs = 0;
+
+            OSAddAtomic(cleaned, &txPrioNumFreeDesc);
+            OSAddAtomic(-(SInt32)bytes, &txInflightBytes);
+            completed += bytes;
+            drvStats.txPrioReclaimPackets++;
+        }
+        ++txPrioDirtyIndex &= kTxPrioDescMask;
+    }
+    return completed;
+}
+
+/*
+ * Copy the headers of a TCP packet to hdr and get the offset of the TCP
+ * header as well as the total header length. Returns false for packets
+ * which aren't suitable for segmentation offload.
+ */
+bool IntelMausi::intelParseTCPHeaders(mbuf_t m, UInt32 tsoFlags, UInt8 *hdr, UInt32 *l4Offset, UInt32 *hdrLen)
+{
+    UInt32 copyLen = min((UInt32)mbuf_pkthdr_len(m), kTSOMaxHdrLen);
+    bool result = false;
+
+    if (mbuf_copydata(m, 0, copyLen, hdr))
+        goto done;
+
+    result = intelTSOParseHeaders(hdr, copyLen, (tsoFlags & MBUF_TSO_IPV4), l4Offset, hdrLen);
+
+done:
+    return result;
+}
+
+/*
+ * Prepare a packet for TCP segmentation offload. The headers are fixed up
+ * for the hardware, the offload parameters are filled in and the packet's
+ * physical segments are returned in segs. A return value of 0
+ * means that the packet has to be sent using checksum offload only. In case
+ * the packet must be segmented in software, *gso is set to true. In case
+ * the packet had to be dropped, *mp is set to NULL.
+ */
+UInt32 IntelMausi::intelSetupTSO(mbuf_t *mp, UInt32 tsoFlags, UInt32 mss, IOPhysicalSegment *segs, struct intelTxOffload *offload, bool *gso)
+{
+    UInt8 hdr[kTSOMaxHdrLen];
+    mbuf_t m = *mp;
+    UInt32 pktLen = (UInt32)mbuf_pkthdr_len(m);
+    UInt32 l4Offset;
+    UInt32 hdrLen;
+    UInt32 numSegs = 0;
+
+    *gso = false;
+
+    if (!mss || !intelParseTCPHeaders(m, tsoFlags, hdr, &l4Offset, &hdrLen))
+        goto drop;
+
+    /* Nothing to segment so that checksum offload is sufficient. */
+    if ((pktLen - hdrLen) <= mss) {
+        drvStats.txTSOFallbacks++;
+        goto done;
+    }
+    numSegs = txMbufCursor->getPhysicalSegmentsWithCoalesce(m, segs, kMaxSegs);
+
+    if (!numSegs)
+        goto drop;
+
+    /*
+     * Segment the packet in software in case TSO isn't reliable at the
+     * current link speed or the buffer layout might hang the transmitter.
+     * A packet which has been sent in part already must be finished the
+     * same way.
+     */
+    if (forceGSO || (m == txGSOPacket) || !intelTSOCheckGeometry(segs, numSegs, hdrLen)) {
+        *gso = true;
+        goto done;
+    }
+    intelTSOSetupHeaders(hdr, l4Offset, (tsoFlags & MBUF_TSO_IPV4));
+
+    if (mbuf_copyback(m, ETH_HLEN, (l4Offset + sizeof(struct tcphdr) - ETH_HLEN), &hdr[ETH_HLEN], MBUF_DONTWAIT))
+        goto drop;
+
+    if (tsoFlags & MBUF_TSO_IPV4) {
+        offload->ipConfig = (((l4Offset - 1) << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
+        offload->cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP | (pktLen - hdrLen));
+        offload->word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
+    } else {
+        offload->ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
+        offload->cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TSE | E1000_TXD_CMD_TCP | (pktLen - hdrLen));
+        offload->word2 = E1000_TXD_OPTS_TXSM;
+    }
+    offload->tcpConfig = (((l4Offset + offsetof(struct tcphdr, th_sum)) << 8) | l4Offset);
+    offload->segSetup = ((mss << 16) | (hdrLen << 8));
+    offload->cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D | E1000_TXD_CMD_TSE);
+
+    drvStats.txTSOPackets++;
+
+done:
+    return numSegs;
+
+drop:
+    DebugLog("[IntelMausi]: Failed to setup TSO. Dropping packet.\n");
+    etherStats->dot3TxExtraEntry.resourceErrors++;
+    drvStats.txTSODrops++;
+    freePacket(m);
+    *mp = NULL;
+    numSegs = 0;
+    goto done;
+}
+
+/*
+ * Segment a TSO packet in software. The headers of each segment are built
+ * in the header buffer while the data descriptors point at the payload of
+ * the original packet so that no payload has to be copied. A packet which
+ * doesn't fit into the free descriptors is sent in batches of segments.
+ * The rest of it is sent when the packet is passed in again. Returns
+ * kIOReturnNoResources in case the packet hasn't been sent completely and
+ * kIOReturnError in case the packet had to be dropped.
+ */
+IOReturn IntelMausi::intelTransmitGSO(mbuf_t m, UInt32 tsoFlags, UInt32 mss, IOPhysicalSegment *segs, UInt32 numSegs)
+{
+    UInt8 hdr[kTSOMaxHdrLen];
+    struct e1000_data_desc *desc;
+    IOReturn result = kIOReturnNoResources;
+    UInt32 pktLen = (UInt32)mbuf_pkthdr_len(m);
+    UInt32 l4Offset;
+    UInt32 hdrLen;
+    UInt32 payloadLen;
+    UInt32 payloadOffset;
+    UInt32 numGSOSegs;
+    UInt32 firstGSOSeg;
+    UInt32 lastGSOSeg;
+    UInt32 maxDescs;
+    UInt32 numDescs;
+    UInt32 needDescs;
+    UInt32 index;
+    UInt32 lastIndex;
+    UInt32 segIndex;
+    UInt32 segOffset;
+    UInt32 segLen;
+    UInt32 remaining;
+    UInt32 chunk;
+    UInt32 wireBytes = 0;
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    UInt32 len;
+    UInt32 cmd;
+    UInt32 opts;
+    UInt32 word1;
+    UInt32 word2;
+    UInt32 csumBase;
+    UInt32 i, j;
+    UInt16 vlanTag;
+    bool ipv4 = (tsoFlags & MBUF_TSO_IPV4);
+
+    if (!intelParseTCPHeaders(m, tsoFlags, hdr, &l4Offset, &hdrLen))
+        goto drop;
+
+    payloadLen = pktLen - hdrLen;
+    numGSOSegs = (payloadLen + mss - 1) / mss;
+    lastGSOSeg = numGSOSegs - 1;
+
+    /* Continue with the next segment in case a batch has been sent already. */
+    firstGSOSeg = (m == txGSOPacket) ? txGSONextSeg : 0;
+
+    /*
+     * Worst case: a context descriptor plus a header and a data descriptor
+     * for each segment plus one more for each buffer boundary. In case the
+     * rest of the packet doesn't fit into the ring at once, there must be
+     * room for at least one segment which may span all buffers.
+     */
+    maxDescs = 1 + 2 * (numGSOSegs - firstGSOSeg) + numSegs;
+
+    if ((maxDescs + kTxSpareDescs) >= numTxDesc)
+        maxDescs = 2 + numSegs;
+
+    if (txNumFreeDesc <= (maxDescs + kTxSpareDescs))
+        goto done;
+
+    /* Locate the start of the payload. */
+    payloadOffset = firstGSOSeg * mss;
+    segIndex = 0;
+    segOffset = hdrLen + payloadOffset;
+
+    while ((segIndex < numSegs) && (segOffset >= segs[segIndex].length)) {
+        segOffset -= segs[segIndex].length;
+        segIndex++;
+    }
+    if (segIndex == numSegs)
+        goto drop;
+
+    /* Prepare the values shared by all segments. */
+    csumBase = intelGSOSetupHeaders(hdr, ipv4);
+    cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+    opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS);
+
+    if (ipv4) {
+        ipConfig = (((l4Offset - 1) << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
+        len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
+        word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
+    } else {
+        ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
+        len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
+        word2 = E1000_TXD_OPTS_TXSM;
+    }
+    tcpConfig = (((l4Offset + offsetof(struct tcphdr, th_sum)) << 8) | l4Offset);
+
+    if (!mbuf_get_vlan_tag(m, &vlanTag)) {
+        opts |= E1000_TXD_CMD_VLE;
+        word2 |= (vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+    }
+    /* One checksum context is used for all segments. */
+    index = txNextDescIndex;
+    numDescs = 0;
+
+    if (intelTxNeedsContext(&txContext, ipConfig, tcpConfig, len, 0)) {
+        intelTxWriteContext(txDescArray, txBufArray, &txContext, index, ipConfig, tcpConfig, len, 0);
+        ++index &= txDescMask;
+        numDescs = 1;
+    } else {
+        drvStats.txContextsSaved++;
+    }
+
+    for (i = firstGSOSeg, lastIndex = index; i < numGSOSegs; i++) {
+        segLen = min(mss, payloadLen - payloadOffset);
+
+        /* End the batch at the first segment which doesn't fit anymore. */
+        if (i > firstGSOSeg) {
+            needDescs = 2;
+            remaining = segLen;
+            chunk = segOffset;
+
+            for (j = segIndex; remaining > ((UInt32)segs[j].length - chunk); j++) {
+                remaining -= (UInt32)segs[j].length - chunk;
+                chunk = 0;
+                needDescs++;
+            }
+            if ((numDescs + needDescs + kTxSpareDescs) >= (UInt32)txNumFreeDesc)
+                break;
+        }
+        /* Build the segment's headers in the bounce buffer slot of its first descriptor. */
+        intelGSOBuildHeaders(&txBounceArray[index * kTxBounceSlotSize], hdr, hdrLen, l4Offset, ipv4, csumBase,
+                             i, lastGSOSeg, payloadOffset, segLen);
+
+        desc = &txDescArray[index];
+        desc->buffer_addr = OSSwapHostToLittleInt64(txBouncePhyAddr + index * kTxBounceSlotSize);
+        desc->lower.data = OSSwapHostToLittleInt32(cmd | hdrLen);
+        desc->upper.data = OSSwapHostToLittleInt32(word2);
+
+        txBufArray[index].mbuf = NULL;
+        txBufArray[index].numDescs = 0;
+
+#ifdef DEBUG
+        txBufArray[index].pad = hdrLen;
+#endif
+
+        ++index &= txDescMask;
+        numDescs++;
+
+        /* The data descriptors point directly at the payload. */
+        for (remaining = segLen; remaining; remaining -= chunk) {
+            chunk = min(remaining, (UInt32)segs[segIndex].length - segOffset);
+            desc = &txDescArray[index];
+            word1 = (cmd | chunk);
+
+            if (chunk == remaining) {
+                word1 |= opts;
+                lastIndex = index;
+            }
+            txBufArray[index].mbuf = NULL;
+            txBufArray[index].numDescs = 0;
+
+#ifdef DEBUG
+            txBufArray[index].pad = chunk;
+#endif
+
+            desc->buffer_addr = OSSwapHostToLittleInt64(segs[segIndex].location + segOffset);
+            desc->lower.data = OSSwapHostToLittleInt32(word1);
+            desc->upper.data = OSSwapHostToLittleInt32(word2);
+
+            segOffset += chunk;
+
+            if (segOffset == segs[segIndex].length) {
+                segOffset = 0;
+                segIndex++;
+            }
+            ++index &= txDescMask;
+            numDescs++;
+        }
+        payloadOffset += segLen;
+        wireBytes += hdrLen + segLen;
+    }
+    /* The last descriptor of the batch reports its completion. */
+    txDescArray[lastIndex].lower.data |= OSSwapHostToLittleInt32(E1000_TXD_CMD_RS);
+    txBufArray[lastIndex].numDescs = numDescs;
+    txBufArray[lastIndex].time = mach_absolute_time();
+
+    OSAddAtomic(-numDescs, &txNumFreeDesc);
+    txNextDescIndex = index;
+    intelItrCountTx(i - firstGSOSeg, wireBytes);
+    drvStats.txGSOSegments += (i - firstGSOSeg);
+
+    if (i == numGSOSegs) {
+        /* The mbuf is released with the last batch. */
+        txBufArray[lastIndex].mbuf = m;
+        txBufArray[lastIndex].bytes = pktLen;
+        OSAddAtomic(pktLen, &txInflightBytes);
+        txGSOPacket = NULL;
+
+        drvStats.txGSOPackets++;
+        result = kIOReturnSuccess;
+    } else {
+        /*
+         * Hand the batch to the hardware now as the caller doesn't ring
+         * the doorbell for a packet which hasn't been sent completely.
+         */
+        txBufArray[lastIndex].bytes = 0;
+        txGSOPacket = m;
+        txGSONextSeg = i;
+        intelUpdateTxDescTail(txNextDescIndex);
+        intelArmTxHangTimer();
+
+        drvStats.txDoorbells++;
+        drvStats.txGSOBatches++;
+    }
+
+done:
+    return result;
+
+drop:
+    DebugLog("[IntelMausi]: Failed to segment TSO packet. Dropping packet.\n");
+    etherStats->dot3TxExtraEntry.resourceErrors++;
+    drvStats.txTSODrops++;
+    freePacket(m);
+    result = kIOReturnError;
+    goto done;
+}
+
 #pragma mark --- timer action methods ---
 
+/*
+ * Release the packets which have been left in the tx ring by
+ * intelTxReclaimDue() so that mbufs aren't held for too long.
+ */
+void IntelMausi::txReclaimTimerAction(IOTimerEventSource *timer)
+{
+    txReclaimTimerArmed = false;
+
+    if (isEnabled) {
+        drvStats.txReclaimTimeouts++;
+        txInterrupt();
+    }
+}
+
+/*
+ * Check the age of the oldest packet in the tx ring. The transmitter is
+ * hung in case the packet hasn't been sent within txHangTimeout and the
+ * head pointer hasn't moved for that long either. The head isn't
+ * expected to move while transmission is paused by flow control.
+ */
+void IntelMausi::txHangTimerAction(IOTimerEventSource *timer)
+{
+    UInt64 now = mach_absolute_time();
+    UInt64 timeout;
+    UInt64 ns;
+    UInt64 oldest = now;
+    UInt32 head;
+    UInt32 prioHead = 0;
+    UInt32 status;
+    UInt32 index;
+
+    txHangTimerArmed = false;
+
+    if (!(isEnabled && linkUp) || ((txNumFreeDesc >= (SInt32)numTxDesc) && (!txPrioDescArray || (txPrioNumFreeDesc >= kNumTxPrioDesc))))
+        goto done;
+
+    drvStats.txHangChecks++;
+    nanoseconds_to_absolutetime(txHangTimeout * 1000000ULL, &timeout);
+
+    head = intelReadMem32(E1000_TDH(0));
+    status = intelReadMem32(E1000_STATUS);
+
+    if (txPrioDescArray)
+        prioHead = intelReadMem32(E1000_TDH(1));
+
+    if ((head != txHangHead) || (prioHead != txPrioHangHead) || (status & E1000_STATUS_TXOFF)) {
+        txHangHead = head;
+        txPrioHangHead = prioHead;
+        txHangProgressTime = now;
+    }
+    /* Find the oldest packet in both rings which hasn't been sent yet. */
+    index = intelTxFindPending(txDescArray, txBufArray, txDirtyIndex, txCleanBarrierIndex, txDescMask);
+
+    if (index != txCleanBarrierIndex)
+        oldest = txBufArray[index].time;
+
+    if (txPrioDescArray) {
+        index = intelTxFindPending(txPrioDescArray, txPrioBufArray, txPrioDirtyIndex, txPrioCleanBarrierIndex, kTxPrioDescMask);
+
+        if ((index != txPrioCleanBarrierIndex) && (txPrioBufArray[index].time < oldest))
+            oldest = txPrioBufArray[index].time;
+    }
+    if ((now - oldest) < timeout)
+        goto rearm;
+
+    drvStats.txHangSuspects++;
+
+    if ((now - txHangProgressTime) < timeout)
+        goto rearm;
+
+    absolutetime_to_nanoseconds(now - txHangProgressTime, &ns);
+    drvStats.txHangLatency = ns;
+    drvStats.txHangResets++;
+
+    IOLog("[IntelMausi]: Tx hang detected after %llums. Resetting chipset. txDirtyDescIndex=%u, TDH=%u, STATUS=0x%08x.\n", ns / 1000000, txDirtyIndex, head, status);
+
+    etherStats->dot3TxExtraEntry.resets++;
+    intelRestart();
+    goto done;
+
+rearm:
+    intelArmTxHangTimer();
+
+done:
+    return;
+}
+
 void IntelMausi::timerAction(IOTimerEventSource *timer)
 {
     struct e1000_hw *hw = &adapterData.hw;
@@ -2593,7 +4014,28 @@ void IntelMausi::timerAction(IOTimerEventSource *timer)
 
         eeeMode = 0;
     }
+    /*
+     * Give back the part of the tx byte queue limit which hasn't been
+     * used since the last run unless the ring ran empty in the meantime.
+     */
+    if (enableTxBQL) {
+        if (!txBQLStarved && (txBQLMinSlack != kTxBQLNoLimit))
+            txBQLLimit = max(txBQLLimit - txBQLMinSlack, kTxBQLMinLimit);
+
+        txBQLMinSlack = kTxBQLNoLimit;
+        txBQLStarved = false;
+    }
+    /* Restart the tx hang check in case it has been missed. */
+    if (txNumFreeDesc < (SInt32)numTxDesc)
+        intelArmTxHangTimer();
+
     updateStatistics(&adapterData);
+    intelUpdateRxCopybreak();
+
+#ifdef __PRIVATE_SPI__
+    intelTunePollParams();
+#endif /* __PRIVATE_SPI__ */
+    updateDriverStatistics();
     timerSource->setTimeoutMS(kTimeoutMS);
 
 done:
@@ -2682,6 +4124,111 @@ void IntelMausi::updateStatistics(struct e1000_adapter *adapter)
     etherStats->dot3RxExtraEntry.frameTooShorts = (UInt32)adapter->stats.ruc;
 }
 
+static void addDriverStat(OSDictionary *dict, const char *key, UInt64 value)
+{
+    OSNumber *num = OSNumber::withNumber(value, 64);
+
+    if (num) {
+        dict->setObject(key, num);
+        num->release();
+    }
+}
+
+void IntelMausi::updateDriverStatistics()
+{
+    OSDictionary *dict = OSDictionary::withCapacity(16);
+    UInt64 ns;
+
+    if (dict) {
+        addDriverStat(dict, "numTxDesc", numTxDesc);
+        addDriverStat(dict, "numRxDesc", numRxDesc);
+        addDriverStat(dict, "txTSOPackets", drvStats.txTSOPackets);
+        addDriverStat(dict, "txTSOFallbacks", drvStats.txTSOFallbacks);
+        addDriverStat(dict, "txTSODrops", drvStats.txTSODrops);
+        addDriverStat(dict, "txGSOPackets", drvStats.txGSOPackets);
+        addDriverStat(dict, "txGSOSegments", drvStats.txGSOSegments);
+        addDriverStat(dict, "txGSOBatches", drvStats.txGSOBatches);
+        addDriverStat(dict, "txContextsSaved", drvStats.txContextsSaved);
+        addDriverStat(dict, "txDoorbells", drvStats.txDoorbells);
+        addDriverStat(dict, "txPacketsPerDoorbell", drvStats.txDoorbells ? (drvStats.txDoorbellPackets / drvStats.txDoorbells) : 0);
+        addDriverStat(dict, "txPacketsPerDequeue", drvStats.txDequeueBatches ? (drvStats.txDequeuePackets / drvStats.txDequeueBatches) : 0);
+        addDriverStat(dict, "txReclaimPackets", drvStats.txReclaimPackets);
+        addDriverStat(dict, "txReclaimCalls", drvStats.txReclaimCalls);
+        addDriverStat(dict, "txReclaimDeferrals", drvStats.txReclaimDeferrals);
+        addDriverStat(dict, "txReclaimTimeouts", drvStats.txReclaimTimeouts);
+        addDriverStat(dict, "txDescsPerReclaim", drvStats.txReclaimCalls ? (drvStats.txReclaimDescs / drvStats.txReclaimCalls) : 0);
+        absolutetime_to_nanoseconds(drvStats.txReclaimPackets ? (drvStats.txHoldTime / drvStats.txReclaimPackets) : 0, &ns);
+        addDriverStat(dict, "txHoldTimeAvgUS", ns / 1000);
+        absolutetime_to_nanoseconds(drvStats.txHoldTimeMax, &ns);
+        addDriverStat(dict, "txHoldTimeMaxUS", ns / 1000);
+        addDriverStat(dict, "txHangTimeout", txHangTimeout);
+        addDriverStat(dict, "txHangChecks", drvStats.txHangChecks);
+        addDriverStat(dict, "txHangSuspects", drvStats.txHangSuspects);
+        addDriverStat(dict, "txHangResets", drvStats.txHangResets);
+        addDriverStat(dict, "txHangLatencyMS", drvStats.txHangLatency / 1000000);
+        addDriverStat(dict, "txCopybreak", txCopybreak);
+        addDriverStat(dict, "txCopybreakPackets", drvStats.txCopybreakPackets);
+        addDriverStat(dict, "txCopybreakPercent", drvStats.txDoorbellPackets ? (drvStats.txCopybreakPackets * 100 / drvStats.txDoorbellPackets) : 0);
+        addDriverStat(dict, "txCoalescedPackets", drvStats.txCoalescedPackets);
+        addDriverStat(dict, "txCoalesceStalls", drvStats.txCoalesceStalls);
+        addDriverStat(dict, "txBQLLimit", enableTxBQL ? txBQLLimit : 0);
+        addDriverStat(dict, "txBQLStalls", drvStats.txBQLStalls);
+        addDriverStat(dict, "txBQLStarvations", drvStats.txBQLStarvations);
+        addDriverStat(dict, "txPrioPackets", drvStats.txPrioPackets);
+        addDriverStat(dict, "txPrioFallbacks", drvStats.txPrioFallbacks);
+        addDriverStat(dict, "txPrioReclaimPackets", drvStats.txPrioReclaimPackets);
+        addDriverStat(dict, "txPrioDoorbells", drvStats.txPrioDoorbells);
+        addDriverStat(dict, "rxBufferSize", rxBufferSize);
+        addDriverStat(dict, "rxPacketSplit", rxPacketSplit);
+        addDriverStat(dict, "rxSplitPackets", drvStats.rxSplitPackets);
+        addDriverStat(dict, "rxSplitPages", drvStats.rxSplitPages);
+        addDriverStat(dict, "rxCopybreak", rxCopybreak);
+        addDriverStat(dict, "rxCopiedPackets", drvStats.rxCopiedPackets);
+        addDriverStat(dict, "rxReplacedPackets", drvStats.rxReplacedPackets);
+        addDriverStat(dict, "rxCopybreakRaises", drvStats.rxCopybreakRaises);
+        addDriverStat(dict, "rxCopybreakCuts", drvStats.rxCopybreakCuts);
+        addDriverStat(dict, "rxPoolLevel", rxPoolCount);
+        addDriverStat(dict, "rxPoolHits", drvStats.rxPoolHits);
+        addDriverStat(dict, "rxPoolMisses", drvStats.rxPoolMisses);
+        addDriverStat(dict, "rxPoolRefills", drvStats.rxPoolRefills);
+        addDriverStat(dict, "rxPoolRecycled", drvStats.rxPoolRecycled);
+        addDriverStat(dict, "rxHashL4Packets", drvStats.rxHashL4Packets);
+        addDriverStat(dict, "rxHashL3Packets", drvStats.rxHashL3Packets);
+        addDriverStat(dict, "rxLroHits", rxLro.hits);
+        addDriverStat(dict, "rxLroMisses", rxLro.misses);
+        addDriverStat(dict, "rxLroEvictions", rxLro.evictions);
+        addDriverStat(dict, "rxLroFlushes", rxLro.flushes);
+        addDriverStat(dict, "rxLroSegsPerFlush", (rxLro.flushes) ? (rxLro.segments / rxLro.flushes) : 0);
+        addDriverStat(dict, "rxBudget", rxBudget);
+        addDriverStat(dict, "rxBudgetHits", drvStats.rxBudgetHits);
+        addDriverStat(dict, "vlanFilterCount", vlanFilterCount);
+        addDriverStat(dict, "itrRate", itrRate);
+        addDriverStat(dict, "itrUpdates", drvStats.itrUpdates);
+        addDriverStat(dict, "itrLowestIntervals", drvStats.itrLowestIntervals);
+        addDriverStat(dict, "itrLowIntervals", drvStats.itrLowIntervals);
+        addDriverStat(dict, "itrBulkIntervals", drvStats.itrBulkIntervals);
+#ifdef __PRIVATE_SPI__
+        addDriverStat(dict, "pollModeSwitches", drvStats.pollModeSwitches);
+        addDriverStat(dict, "pollCalls", drvStats.pollCalls);
+        addDriverStat(dict, "pollPacketsPerPoll", drvStats.pollCalls ? (drvStats.pollPackets / drvStats.pollCalls) : 0);
+        addDriverStat(dict, "pollEmpty", drvStats.pollEmpty);
+        absolutetime_to_nanoseconds(drvStats.pollTime, &ns);
+        addDriverStat(dict, "pollTimeMS", ns / 1000000);
+        absolutetime_to_nanoseconds(drvStats.intrTime, &ns);
+        addDriverStat(dict, "intrTimeMS", ns / 1000000);
+        addDriverStat(dict, "pollIntervalUS", pollParams.pollIntervalTime / 1000);
+        addDriverStat(dict, "pollThresholdScale", pollThresholdScale);
+        addDriverStat(dict, "pollParamUpdates", drvStats.pollParamUpdates);
+#endif /* __PRIVATE_SPI__ */
+#ifdef DEBUG
+        addDriverStat(dict, "rxHashMismatches", drvStats.rxHashMismatches);
+#endif
+
+        setProperty(kDriverStatsName, dict);
+        dict->release();
+    }
+}
+
 bool IntelMausi::checkForDeadlock()
 {
     bool deadlock = false;
@@ -2693,7 +4240,8 @@ bool IntelMausi::checkForDeadlock()
         eeeMode = 0;
     }
 
-    if ((txDescDoneCount == txDescDoneLast) && (txNumFreeDesc < kNumTxDesc)) {
+    /* The deadlock check is only needed without the tx hang check. */
+    if (!txHangTimeout && (txDescDoneCount == txDescDoneLast) && (txNumFreeDesc < numTxDesc)) {
         if (++deadlockWarn >= kTxDeadlockTreshhold) {
             mbuf_t m = txBufArray[txDirtyIndex].mbuf;
             UInt32 pktSize;
@@ -2709,7 +4257,7 @@ bool IntelMausi::checkForDeadlock()
 
 #ifdef DEBUG
             for (i = 0; i < 30; i++) {
-                index = ((stalledIndex - 20 + i) & kTxDescMask);
+                index = ((stalledIndex - 20 + i) & txDescMask);
 
                 IOLog("[IntelMausi]: desc[%u]: lower=0x%08x, upper=0x%08x, addr=0x%016llx, mbuf=0x%016llx, len=%u.\n", index, txDescArray[index].lower.data, txDescArray[index].upper.data, txDescArray[index].buffer_addr, (UInt64)txBufArray[index].mbuf, txBufArray[index].pad);
             }
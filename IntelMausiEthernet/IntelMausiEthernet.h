@@ -90,20 +90,125 @@ enum {
 
 #define kTxSpareDescs   16
 
-/* The number of descriptors must be a power of 2. */
-#define kNumTxDesc      1024        /* Number of Tx descriptors */
-#define kNumRxDesc      512         /* Number of Rx descriptors */
-#define kNumKdpDesc     kNumTxDesc  /* Number of Kdp descriptors */
-#define kTxLastDesc    (kNumTxDesc - 1)
-#define kRxLastDesc    (kNumRxDesc - 1)
-#define kTxDescMask    (kNumTxDesc - 1)
-#define kRxDescMask    (kNumRxDesc - 1)
-#define kTxDescSize    (kNumTxDesc*sizeof(struct e1000_data_desc))
-#define kRxDescSize    (kNumRxDesc*sizeof(union e1000_rx_desc_extended))
+/* Maximum number of packets queued before the tx doorbell is rung. */
+#define kTxDoorbellBatch    16
+
+/*
+ * The tx bounce buffer has one slot per descriptor. It holds the headers
+ * of software segmented TSO packets and small packets which are copied
+ * instead of being mapped. It's followed by the coalescing pool, a ring
+ * of buffers for packets with more than kMaxSegs fragments. As packets
+ * complete in order, the buffers are released in the order they have
+ * been claimed.
+ */
+#define kTxBounceSlotSize   256
+#define kTxCopybreakDefault 128
+#define kTxCoalesceBufSize  0x4000
+#define kTxNumCoalesceBufs  16
+#define kTxCoalesceMask     (kTxNumCoalesceBufs - 1)
+#define kTxCoalesceOffset(n) ((n) * kTxBounceSlotSize)
+#define kTxBounceBufSize(n)  (kTxCoalesceOffset(n) + kTxNumCoalesceBufs * kTxCoalesceBufSize)
+
+/*
+ * The ring sizes are configurable. The number of descriptors must be
+ * a power of 2 in the range from kMinNumDesc to kMaxNumDesc.
+ */
+#define kNumTxDescDefault   1024    /* Default number of Tx descriptors */
+#define kNumRxDescDefault   512     /* Default number of Rx descriptors */
+#define kMinNumDesc         64
+#define kMaxNumDesc         4096
+#define kNumKdpDesc         1024    /* Number of Kdp descriptors */
+#define kTxDescSize(n)      ((n) * sizeof(struct e1000_data_desc))
+#define kRxDescSize(n)      ((n) * sizeof(union e1000_rx_desc_extended))
+#define kIsValidRingSize(n) (((n) >= kMinNumDesc) && ((n) <= kMaxNumDesc) && !((n) & ((n) - 1)))
+
+/*
+ * With TSO enabled the tx ring must hold a 64 KB packet segmented in
+ * software with an MSS of 1448 bytes: 1 + 2 * 46 + kMaxSegs descriptors
+ * plus kTxSpareDescs.
+ */
+#define kMinNumTSODesc      256
+
+/*
+ * The optional priority ring uses the second hardware queue for control
+ * and interactive traffic so that it doesn't wait behind bulk transfers.
+ * Packets are selected by their service class or, without the private
+ * SPI, by VLAN priority and DSCP.
+ */
+#define kNumTxPrioDesc      256
+#define kTxPrioDescMask     (kNumTxPrioDesc - 1)
+#define kTxPrioMinPCP       5       /* voice and network control */
+#define kTxPrioMinDSCP      40      /* CS5 and above including EF */
 
 /* This is the receive buffer size (must be large enough to hold a packet). */
 #define kRxBufferPktSize 2048
-#define kRxNumSpareMbufs 100
+
+/*
+ * The receive buffer size follows the MTU so that a frame fits into a
+ * single buffer. 4K and 16K buffers are used for jumbo frames. Buffers
+ * must not cross a page boundary unless they are larger than a page.
+ */
+#define kRxBufferSize4K         4096
+#define kRxBufferSize16K        16384
+#define kRxFrameSize(mtu)       ((mtu) + ETH_HLEN + 4 + ETH_FCS_LEN)    /* with VLAN tag */
+#define kRxBufferSize(mtu)      ((kRxFrameSize(mtu) <= kRxBufferPktSize) ? kRxBufferPktSize : \
+                                 ((kRxFrameSize(mtu) <= kRxBufferSize4K) ? kRxBufferSize4K : kRxBufferSize16K))
+#define kRxBufferAlignMask(n)   ((((n) < PAGE_SIZE) ? (n) : PAGE_SIZE) - 1)
+
+/*
+ * In packet split mode the headers of a frame are placed in a small
+ * buffer and the payload in up to 3 pages. It replaces the 4K and 16K
+ * buffers for jumbo frames when enabled.
+ */
+#define kRxPSHdrBufSize         256
+#define kRxPSHdrSize(n)         ((n) * kRxPSHdrBufSize)
+#define kRxPSDescSize(n)        ((n) * sizeof(union e1000_rx_desc_packet_split))
+#define kRxPSNumPages(size)     (((size) / PAGE_SIZE < PS_PAGE_BUFFERS) ? ((size) / PAGE_SIZE) : PS_PAGE_BUFFERS)
+
+/*
+ * Received packets up to the copybreak size are copied so that the buffer
+ * stays in the ring. The threshold adapts between kRxCopybreakMin and
+ * kRxCopybreakMax: it goes up when buffers can't be replaced and down when
+ * packets are missed because the host doesn't keep up.
+ */
+#define kRxCopybreakDefault     256
+#define kRxCopybreakMin         128
+#define kRxCopybreakMax         kRxBufferPktSize
+
+/*
+ * Maximum number of packets received per interrupt. Once it is exhausted
+ * the rx interrupts stay masked and the ring is processed again from
+ * rxBudgetSource so that the work loop gets a chance to run other work.
+ */
+#define kRxBudgetDefault        64
+#define kRxBudgetMin            16
+#define kRxBudgetMax            kMaxNumDesc
+#define kIntelRxIntrMask        (E1000_ICR_RXQ0 | E1000_ICR_RXT0 | E1000_ICR_RXDMT0)
+
+/*
+ * VLAN IDs which pass the hardware VLAN filter. Frames tagged with other
+ * IDs are dropped by the MAC once the list isn't empty.
+ */
+#define kVlanIdMax              4094
+#define kVlanFilterWords        E1000_VLAN_FILTER_TBL_SIZE
+
+/* RSS hash type reported in the low bits of wb.lower.mrq */
+#define kRxRssTypeMask          0x0000000F
+#define kRxRssTypeNone          0
+#define kRxRssTypeTCPIPv4       1
+#define kRxRssTypeIPv4          2
+#define kRxRssTypeTCPIPv6       3
+#define kRxRssTypeIPv6Ex        4
+#define kRxRssTypeIPv6          5
+
+/*
+ * Pool of mapped receive buffers which replace the buffers handed up to
+ * the stack. It is refilled after each run of rxInterrupt() so that the
+ * per packet path doesn't need to allocate and map buffers.
+ */
+#define kRxPoolSize             256
+#define kRxPoolMask             (kRxPoolSize - 1)
+#define kRxPoolRefillBatch      64
 #define kMCFilterLimit 32
 #define kMaxRxQueques 1
 #define kMaxMtu 9000
@@ -112,12 +217,51 @@ enum {
 /* statitics timer period in ms. */
 #define kTimeoutMS 1000
 
+/*
+ * Input polling parameters are tuned once per timer period. The poll
+ * interval is chosen so that a poll yields about kPollTargetYield packets
+ * at the arrival rate seen while polling. The thresholds are scaled up
+ * when the interface keeps switching between polling and interrupts.
+ */
+#define kPollIntervalMin        50000       /* 50µs */
+#define kPollIntervalMax        1000000     /* 1ms */
+#define kPollTargetYield        16
+#define kPollSwitchesMax        8
+#define kPollThresholdScaleMax  8
+
+/*
+ * Limits of the tx byte queue limit. The limit is the number of bytes
+ * which must be in flight to keep the wire busy.
+ */
+#define kTxBQLMinLimit  (2 * kMaxPacketSize)
+#define kTxBQLMaxLimit  (1024 * 1024)
+#define kTxBQLNoLimit   0xffffffff
+
+/*
+ * Completed tx packets are released in batches once the percentage of
+ * free descriptors drops below the watermark. The reclaim timer releases
+ * them after a timeout (in us) when the ring doesn't fill up.
+ */
+#define kTxReclaimWatermarkDefault  50
+#define kTxReclaimMinWatermark      (kMaxSegs + kTxSpareDescs + 1)
+#define kTxReclaimTimeoutDefault    1000
+#define kTxReclaimTimeoutMax        100000
+
 /* Treshhold value to wake a stalled queue */
-#define kTxQueueWakeTreshhold (kNumTxDesc / 4)
+#define kTxQueueWakeTreshhold(n) ((n) / 4)
 
 /* transmitter deadlock treshhold in seconds. */
 #define kTxDeadlockTreshhold 2
 
+/*
+ * The transmitter is considered hung when the oldest packet in the ring
+ * hasn't been sent within the timeout (in ms) and the head pointer didn't
+ * move either. The ring is checked twice per timeout while it's busy.
+ */
+#define kTxHangTimeoutDefault   100
+#define kTxHangTimeoutMin       20
+#define kTxHangTimeoutMax       2000
+
 /* Maximum DMA latency in ns. */
 #define kMaxDmaLatency 75000
 
@@ -149,6 +293,10 @@ enum {
 #define kUDPv6CSumOffset    (offsetof(struct udphdr, uh_sum) + kMinL4HdrOffsetV6)
 #define kUDPv6CSumEnd       0
 
+#include "IntelMausiTSO.h"
+#include "IntelMausiRSS.h"
+#include "IntelMausiITR.h"
+
 #define SPEED_MODE_BIT (1 << 21)
 #define E1000_TARC_QUEUE_EN   0x00000400
 
@@ -185,6 +333,9 @@ enum {
 #define E1000_TXD_OPTS_IXSM     0x00000100
 #define E1000_TXD_OPTS_TXSM     0x00000200
 
+#include "IntelMausiTx.h"
+#include "IntelMausiLRO.h"
+
 #define E1000_RCTL_FLXB_SHIFT   27
 
 #define E1000_ICR_TXQE          0x00000002      /* Transmit queue empty */
@@ -240,11 +391,28 @@ enum
 
 #define kParamName "Driver Parameters"
 #define kEnableCSO6Name "enableCSO6"
+#define kEnableTSO4Name "enableTSO4"
+#define kEnableTSO6Name "enableTSO6"
+#define kTxCopybreakName "txCopybreak"
+#define kRxCopybreakName "rxCopybreak"
+#define kNumTxDescName "numTxDesc"
+#define kNumRxDescName "numRxDesc"
+#define kEnableTxBQLName "enableTxBQL"
+#define kEnableTxPrioQueueName "enableTxPrioQueue"
+#define kEnableRxPacketSplitName "enableRxPacketSplit"
+#define kEnableRxLROName "enableRxLRO"
+#define kRxBudgetName "rxBudget"
+#define kVlanFilterName "vlanFilter"
+#define kEnableAdaptiveITRName "enableAdaptiveITR"
+#define kTxReclaimWatermarkName "txReclaimWatermark"
+#define kTxReclaimTimeoutName "txReclaimTimeout"
+#define kTxHangTimeoutName "txHangTimeout"
 #define kEnableWoMName "enableWakeOnAddrMatch"
 #define kIntrRate10Name "maxIntrRate10"
 #define kIntrRate100Name "maxIntrRate100"
 #define kIntrRate1000Name "maxIntrRate1000"
 #define kDriverVersionName "Driver_Version"
+#define kDriverStatsName "Driver Statistics"
 #define kNameLenght 64
 
 #define kRxAbsTime10Name "rxAbsTime10"
@@ -264,16 +432,76 @@ struct intelDevice {
 
 #define kInvalidRingIndex 0xffffffff;
 
-struct intelTxBufferInfo {
-    mbuf_t mbuf;
-    UInt32 numDescs;
-    UInt32 pad;
+struct intelDriverStats {
+    UInt64 txTSOPackets;        /* packets sent using hardware TSO */
+    UInt64 txTSOFallbacks;      /* TSO requests sent with checksum offload only */
+    UInt64 txTSODrops;          /* malformed TSO packets */
+    UInt64 txGSOPackets;        /* TSO packets segmented in software */
+    UInt64 txGSOSegments;       /* segments created in software */
+    UInt64 txGSOBatches;        /* partial batches of segments of large packets */
+    UInt64 txContextsSaved;     /* context descriptors saved by reusing the last one */
+    UInt64 txDoorbells;         /* tx tail register updates */
+    UInt64 txDoorbellPackets;   /* packets made visible by those updates */
+    UInt64 txDequeueBatches;    /* calls of dequeueOutputPackets() */
+    UInt64 txDequeuePackets;    /* packets returned by those calls */
+    UInt64 txReclaimPackets;    /* packets released by txInterrupt() */
+    UInt64 txReclaimCalls;      /* runs of txInterrupt() */
+    UInt64 txReclaimDescs;      /* descriptors released by those runs */
+    UInt64 txReclaimDeferrals;  /* interrupts which didn't release packets */
+    UInt64 txReclaimTimeouts;   /* runs triggered by the reclaim timer */
+    UInt64 txHoldTime;          /* time the packets were held (absolute time) */
+    UInt64 txHoldTimeMax;       /* maximum time a packet was held */
+    UInt64 txHangChecks;        /* runs of the tx hang check */
+    UInt64 txHangSuspects;      /* checks which found a packet older than the timeout */
+    UInt64 txHangResets;        /* resets after a tx hang has been detected */
+    UInt64 txHangLatency;       /* time from the last progress to the last reset (ns) */
+    UInt64 txCopybreakPackets;  /* small packets sent from the bounce buffer */
+    UInt64 txCoalescedPackets;  /* packets copied into the coalescing pool */
+    UInt64 txCoalesceStalls;    /* packets delayed because the pool was empty */
+    UInt64 txBQLStalls;         /* output stopped by the byte queue limit */
+    UInt64 txBQLStarvations;    /* tx ring ran empty while output was stopped */
+    UInt64 txPrioPackets;       /* packets sent on the priority ring */
+    UInt64 txPrioFallbacks;     /* priority packets sent on the default ring */
+    UInt64 txPrioReclaimPackets; /* packets released from the priority ring */
+    UInt64 txPrioDoorbells;     /* priority ring tail register updates */
+    UInt64 rxSplitPackets;      /* packets received in packet split mode */
+    UInt64 rxSplitPages;        /* payload pages handed up with them */
+    UInt64 rxCopiedPackets;     /* packets copied below the copybreak */
+    UInt64 rxReplacedPackets;   /* packets handed up with their buffer */
+    UInt64 rxCopybreakRaises;   /* copybreak raised after allocation failures */
+    UInt64 rxCopybreakCuts;     /* copybreak lowered after missed packets */
+    UInt64 rxPoolHits;          /* buffers taken from the rx pool */
+    UInt64 rxPoolMisses;        /* buffers allocated because the pool was empty */
+    UInt64 rxPoolRefills;       /* buffers added to the pool */
+    UInt64 rxPoolRecycled;      /* discarded buffers put back into the pool */
+    UInt64 rxHashL4Packets;     /* packets with an RSS hash over addresses and ports */
+    UInt64 rxHashL3Packets;     /* packets with an RSS hash over addresses only */
+    UInt64 rxHashMismatches;    /* hashes which differ from the software reference (debug) */
+    UInt64 rxBudgetHits;        /* rx runs which exhausted their budget */
+    UInt64 itrUpdates;          /* writes of a new adaptive interrupt rate */
+    UInt64 itrLowestIntervals;  /* intervals classified as lowest latency */
+    UInt64 itrLowIntervals;     /* intervals classified as low latency */
+    UInt64 itrBulkIntervals;    /* intervals classified as bulk */
+    UInt64 pollModeSwitches;    /* changes between polling and interrupt mode */
+    UInt64 pollCalls;           /* calls of pollInputPackets() */
+    UInt64 pollPackets;         /* packets received by them */
+    UInt64 pollEmpty;           /* polls which found no packets */
+    UInt64 pollTime;            /* time spent in polling mode */
+    UInt64 intrTime;            /* time spent in interrupt mode */
+    UInt64 pollParamUpdates;    /* polling parameters handed to the interface */
 };
+
 struct intelRxBufferInfo {
     mbuf_t mbuf;
     IOPhysicalAddress64 phyAddr;
 };
 
+/* The payload pages of a packet split descriptor. */
+struct intelRxPSBufferInfo {
+    mbuf_t page[PS_PAGE_BUFFERS];
+    IOPhysicalAddress64 phyAddr[PS_PAGE_BUFFERS];
+};
+
 struct IntelRxDesc {
     UInt64 bufferAddr;
     UInt64 status;
@@ -330,6 +558,8 @@ public:
     virtual IOReturn outputStart(IONetworkInterface *interface, IOOptionBits options) APPLE_KEXT_OVERRIDE;
     virtual IOReturn setInputPacketPollingEnable(IONetworkInterface *interface, bool enabled) APPLE_KEXT_OVERRIDE;
     virtual void pollInputPackets(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context) APPLE_KEXT_OVERRIDE;
+    void intelPollAccountTime();
+    void intelTunePollParams();
 #else
     virtual UInt32 outputPacket(mbuf_t m, void *param) APPLE_KEXT_OVERRIDE;
 #endif /* __PRIVATE_SPI__ */
@@ -338,6 +568,8 @@ public:
 
     virtual IOOutputQueue* createOutputQueue() APPLE_KEXT_OVERRIDE;
 
+    virtual IOReturn setProperties(OSObject *properties) APPLE_KEXT_OVERRIDE;
+
     virtual const OSString* newVendorString() const APPLE_KEXT_OVERRIDE;
     virtual const OSString* newModelString() const APPLE_KEXT_OVERRIDE;
 
@@ -374,22 +606,56 @@ private:
     bool setupMediumDict();
     bool initEventSources(IOService *provider);
     void interruptOccurred(OSObject *client, IOInterruptEventSource *src, int count);
+    void rxBudgetAction(OSObject *client, IOInterruptEventSource *src, int count);
+    inline bool intelRxPending();
+    bool intelRxBudgetExceeded();
     void txInterrupt(IOOptionBits options = 0);
     void freePacketEx(mbuf_t pkt, IOOptionBits options = 0);
     void kdpStartup();
+    bool intelParseTCPHeaders(mbuf_t m, UInt32 tsoFlags, UInt8 *hdr, UInt32 *l4Offset, UInt32 *hdrLen);
+    UInt32 intelSetupTSO(mbuf_t *mp, UInt32 tsoFlags, UInt32 mss, IOPhysicalSegment *segs, struct intelTxOffload *offload, bool *gso);
+    IOReturn intelTransmitGSO(mbuf_t m, UInt32 tsoFlags, UInt32 mss, IOPhysicalSegment *segs, UInt32 numSegs);
+    UInt32 intelTxFillDescs(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, UInt16 *nextIndex, SInt32 *numFreeDesc,
+                            UInt32 mask, struct intelTxContext *context, mbuf_t m, IOPhysicalSegment *segs, UInt32 numSegs,
+                            const struct intelTxOffload *offload);
+    bool intelTransmitCopy(mbuf_t m, UInt32 pktLen, const struct intelTxOffload *offload);
+    IOReturn intelTxGetSegments(mbuf_t m, IOPhysicalSegment *segs, UInt32 *numSegs, bool *coalesced);
+    void intelTxDetachMbuf(mbuf_t m, bool coalesced);
+    inline UInt32 intelTxReleasePacket(UInt32 index, UInt64 now, IOOptionBits options);
+    bool intelTxReclaimDue();
+    inline void intelArmTxHangTimer();
+    inline void intelItrCountTx(UInt32 packets, UInt32 bytes);
+    void intelUpdateTxBQL(UInt32 completed);
+    void intelResetTxBQL();
+    bool intelIsPrioPacket(mbuf_t m);
+    bool intelTransmitPrio(mbuf_t m);
+    void intelFlushTxPrio();
+    UInt32 intelTxPrioInterrupt(IOOptionBits options);
     bool isKdpPacket(UInt8 *data, UInt32 len);
 
 #ifdef __PRIVATE_SPI__
     UInt32 rxInterrupt(IONetworkInterface *interface, uint32_t maxCount, IOMbufQueue *pollQueue, void *context);
+    inline void intelRxInput(IONetworkInterface *interface, IOMbufQueue *pollQueue, mbuf_t m);
 #else
-    void rxInterrupt();
+    UInt32 rxInterrupt(UInt32 maxCount);
+    inline void intelRxInput(mbuf_t m);
+    void intelFlushTxBatch();
 #endif /* __PRIVATE_SPI__ */
 
     bool setupDMADescriptors();
     void freeDMADescriptors();
+    IOReturn intelResizeRings(UInt32 txSize, UInt32 rxSize, UInt32 bufSize);
+    static IOReturn resizeRingsAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
+    bool intelParseVlanFilter(OSArray *array, UInt32 *table, UInt32 *count);
+    static IOReturn setVlanFilterAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4);
     void clearDescriptors();
+    bool setupRxPacketSplit();
+    void freeRxPacketSplit();
+    void intelRxPSInitDesc(UInt32 index);
+    mbuf_t intelRxSplitPacket(UInt32 status, UInt32 *hash);
     void checkLinkStatus();
     void updateStatistics(struct e1000_adapter *adapter);
+    void updateDriverStatistics();
     void setLinkUp();
     void setLinkDown();
     bool checkForDeadlock();
@@ -419,10 +685,17 @@ private:
     bool intelEnableMngPassThru(struct e1000_hw *hw);
     void intelResetAdaptive(struct e1000_hw *hw);
     void intelUpdateAdaptive(struct e1000_hw *hw);
+    UInt32 intelResetITR();
+    void intelUpdateITR();
     void intelVlanStripDisable(struct e1000_adapter *adapter);
     void intelVlanStripEnable(struct e1000_adapter *adapter);
+    void intelVlanFilterSetup(struct e1000_adapter *adapter);
     void intelRssKeyFill(void *buffer, size_t len);
     void intelSetupRssHash(struct e1000_adapter *adapter);
+    inline UInt32 intelGetRssHash(mbuf_t m, UInt32 mrq, UInt32 rss);
+#ifdef DEBUG
+    void intelVerifyRssHash(mbuf_t m, UInt32 hash);
+#endif
 
     void intelRestart();
     bool intelCheckLink(struct e1000_adapter *adapter);
@@ -441,11 +714,21 @@ private:
     SInt32 intelEnableEEE(struct e1000_hw *hw, UInt16 mode);
 
     inline void intelGetChecksumResult(mbuf_t m, UInt32 status);
+    inline mbuf_t intelRxCopyOrReplace(mbuf_t *bufPkt, UInt32 pktSize, IOPhysicalAddress64 *addr, bool *replaced);
+    bool intelRxAllocBuffer(mbuf_t *m, IOPhysicalAddress64 *addr);
+    inline bool intelRxPoolGet(mbuf_t *m, IOPhysicalAddress64 *addr);
+    void intelRxPoolPut(mbuf_t m, IOPhysicalAddress64 addr);
+    void intelRxPoolRefill(UInt32 count);
+    void intelRxPoolFree();
+    bool intelRxRecycleBuffer(mbuf_t m);
+    void intelUpdateRxCopybreak();
 
     void getAddressList(struct IntelAddrData *addr);
 
     /* timer action */
     void timerAction(IOTimerEventSource *timer);
+    void txReclaimTimerAction(IOTimerEventSource *timer);
+    void txHangTimerAction(IOTimerEventSource *timer);
 
 private:
     IOWorkLoop *workLoop;
@@ -456,7 +739,10 @@ private:
     IOBasicOutputQueue *txQueue;
 
     IOInterruptEventSource *interruptSource;
+    IOInterruptEventSource *rxBudgetSource;
     IOTimerEventSource *timerSource;
+    IOTimerEventSource *txReclaimTimer;
+    IOTimerEventSource *txHangTimer;
     IOEthernetInterface *netif;
     IOMemoryMap *baseMap;
     volatile void *baseAddr;
@@ -469,6 +755,8 @@ private:
     IOPhysicalAddress64 txPhyAddr;
     struct e1000_data_desc *txDescArray;
     IOMbufNaturalMemoryCursor *txMbufCursor;
+    UInt32 numTxDesc;
+    UInt32 txDescMask;
     UInt64 txDescDoneCount;
     UInt64 txDescDoneLast;
     SInt32 txNumFreeDesc;
@@ -477,13 +765,71 @@ private:
     UInt16 txNextDescIndex;
     UInt16 txDirtyIndex;
     UInt16 txCleanBarrierIndex;
+    struct intelTxContext txContext;
+    mbuf_t txGSOPacket;
+    UInt32 txGSONextSeg;
+    UInt32 txCopybreak;
+    UInt32 txCoalesceNext;
+    SInt32 txCoalesceFree;
+    UInt32 txReclaimPercent;
+    UInt32 txReclaimWatermark;
+    UInt32 txReclaimTimeout;
+    UInt32 txHangTimeout;
+    UInt32 txHangHead;
+    UInt32 txPrioHangHead;
+    UInt64 txHangProgressTime;
+
+    /* tx byte queue limit */
+    SInt32 txInflightBytes;
+    UInt32 txBQLLimit;
+    UInt32 txBQLMinSlack;
+    bool txBQLLimited;
+    bool txBQLStarved;
+
+    /* tx bounce buffer */
+    IODMACommand *txBounceDmaCmd;
+    IOBufferMemoryDescriptor *txBounceDesc;
+    IOPhysicalAddress64 txBouncePhyAddr;
+    UInt8 *txBounceArray;
+
+    /* tx priority ring */
+    IODMACommand *txPrioDescDmaCmd;
+    IOBufferMemoryDescriptor *txPrioBufDesc;
+    IOPhysicalAddress64 txPrioPhyAddr;
+    struct e1000_data_desc *txPrioDescArray;
+    SInt32 txPrioNumFreeDesc;
+    UInt16 txPrioNextDescIndex;
+    UInt16 txPrioDirtyIndex;
+    UInt16 txPrioCleanBarrierIndex;
+    struct intelTxContext txPrioContext;
+
+#ifdef __PRIVATE_SPI__
+    /* chain of dequeued packets which haven't been sent yet */
+    mbuf_t txPendingPacket;
+#else
+    UInt32 txPendingPackets;
+#endif /* __PRIVATE_SPI__ */
 
     /* receiver data */
     IODMACommand *rxDescDmaCmd;
     IOBufferMemoryDescriptor *rxBufDesc;
     IOPhysicalAddress64 rxPhyAddr;
     union e1000_rx_desc_extended *rxDescArray;
+    union e1000_rx_desc_packet_split *rxPSDescArray;
     IOMbufNaturalMemoryCursor *rxMbufCursor;
+    UInt32 numRxDesc;
+    UInt32 rxDescMask;
+    UInt32 rxBufferSize;
+    UInt32 rxPSNumPages;
+    UInt32 rxPoolBufSize;
+    UInt32 rxPoolHead;
+    UInt32 rxPoolCount;
+    UInt32 rxCopybreak;
+    UInt32 rxCopybreakInit;
+    UInt32 rxCopybreakErrors;
+    UInt64 rxCopybreakMissed;
+    UInt32 rxBudget;
+    UInt32 vlanFilterCount;
     mbuf_t rxPacketHead;
     mbuf_t rxPacketTail;
     UInt32 rxPacketSize;
@@ -492,6 +838,12 @@ private:
     UInt16 rxNextDescIndex;
     UInt16 rxCleanedCount;
 
+    /* header buffers of the packet split mode */
+    IODMACommand *rxPSHdrDmaCmd;
+    IOBufferMemoryDescriptor *rxPSHdrBufDesc;
+    IOPhysicalAddress64 rxPSHdrPhyAddr;
+    UInt8 *rxPSHdrArray;
+
     /* power management data */
     unsigned long powerState;
 
@@ -499,12 +851,20 @@ private:
     UInt32 deadlockWarn;
     IONetworkStats *netStats;
     IOEthernetStats *etherStats;
+    struct intelDriverStats drvStats;
 
     UInt32 chip;
     UInt32 chipType;
     UInt32 intrThrValue10;
     UInt32 intrThrValue100;
     UInt32 intrThrValue1000;
+    UInt32 itrRate;
+    UInt32 itrRxClass;
+    UInt32 itrTxClass;
+    UInt32 itrRxPackets;
+    UInt32 itrRxBytes;
+    SInt32 itrTxPackets;
+    SInt32 itrTxBytes;
     struct e1000_adapter adapterData;
     struct pci_dev pciDeviceData;
 
@@ -524,6 +884,15 @@ private:
 
 #ifdef __PRIVATE_SPI__
     IONetworkPacketPollingParameters pollParams;
+    IONetworkPacketPollingParameters pollBaseParams;
+
+    /* Updated by the poller thread too, see intelTunePollParams(). */
+    volatile UInt64 pollModeStart;
+    volatile SInt64 pollTimePeriod;
+    volatile SInt32 pollCallsPeriod;
+    volatile SInt32 pollPacketsPeriod;
+    volatile SInt32 pollSwitchesPeriod;
+    UInt32 pollThresholdScale;
 #endif /* __PRIVATE_SPI__ */
 
     /* flags */
@@ -540,14 +909,31 @@ private:
 #endif /* __PRIVATE_SPI__ */
 
     bool forceReset;
+    bool forceGSO;
     bool wolCapable;
     bool wolActive;
     bool enableCSO6;
+    bool enableAdaptiveITR;
+    bool enableTSO4;
+    bool enableTSO6;
     bool enableWoM;
-
-    /* mbuf_t arrays */
-    struct intelTxBufferInfo txBufArray[kNumTxDesc];
-    struct intelRxBufferInfo rxBufArray[kNumRxDesc];
+    bool enableTxBQL;
+    bool enableTxPrioQueue;
+    bool enableRxPacketSplit;
+    bool enableRxLRO;
+    bool rxPacketSplit;
+    bool rxBudgetPending;
+    bool txReclaimTimerArmed;
+    bool txHangTimerArmed;
+
+    /* mbuf_t arrays, allocated to match the ring sizes */
+    struct intelTxBufferInfo *txBufArray;
+    struct intelRxBufferInfo *rxBufArray;
+    struct intelRxPSBufferInfo *rxPSBufArray;
+    struct intelRxBufferInfo rxPoolArray[kRxPoolSize];
+    struct intelLroTable rxLro;
+    UInt32 vlanFilterTable[kVlanFilterWords];
+    struct intelTxBufferInfo txPrioBufArray[kNumTxPrioDesc];
 
     /* debugger array pool */
     mbuf_t kdpBufArray[kNumKdpDesc];
@@ -515,6 +515,7 @@ void IntelMausi::intelConfigure(struct e1000_adapter *adapter)
 
     /* Setup reciever */
     intelSetupRxControl(adapter);
+    intelVlanFilterSetup(adapter);
     intelConfigureRx(adapter);
 }
 
@@ -531,7 +532,7 @@ void IntelMausi::intelConfigureTx(struct e1000_adapter *adapter)
 {
     struct e1000_hw *hw = &adapter->hw;
     u64 tdba = txPhyAddr;
-    u32 tdlen = kTxDescSize, tctl, tarc;
+    u32 tdlen = kTxDescSize(numTxDesc), tctl, tarc;
     u32 txdctl;
 
     /* Setup the HW Tx Head and Tail descriptor pointers */
@@ -542,10 +543,22 @@ void IntelMausi::intelConfigureTx(struct e1000_adapter *adapter)
     intelWriteMem32(E1000_TDT(0), 0);
 
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txNumFreeDesc = numTxDesc;
 
     intelUpdateTxDescTail(0);
 
+    /* Setup the priority ring on the second queue. */
+    if (txPrioDescArray) {
+        intelWriteMem32(E1000_TDBAL(1), (txPrioPhyAddr & DMA_BIT_MASK(32)));
+        intelWriteMem32(E1000_TDBAH(1), (txPrioPhyAddr >> 32));
+        intelWriteMem32(E1000_TDLEN(1), kTxDescSize(kNumTxPrioDesc));
+        intelWriteMem32(E1000_TDH(1), 0);
+        intelWriteMem32(E1000_TDT(1), 0);
+
+        txPrioNextDescIndex = txPrioDirtyIndex = txPrioCleanBarrierIndex = 0;
+        txPrioNumFreeDesc = kNumTxPrioDesc;
+    }
+
     /* Set the Tx Interrupt Delay register */
     intelWriteMem32(E1000_TIDV, adapter->tx_int_delay);
     /* Tx irq moderation */
@@ -601,6 +614,13 @@ void IntelMausi::intelConfigureTx(struct e1000_adapter *adapter)
         intelWriteMem32(E1000_TARC(1), tarc);
     }
 
+    /* The second queue is only used by the priority ring. */
+    if (txPrioDescArray) {
+        tarc = intelReadMem32(E1000_TARC(1));
+        tarc |= E1000_TARC_QUEUE_EN;
+        intelWriteMem32(E1000_TARC(1), tarc);
+    }
+
     intelWriteMem32(E1000_TCTL, tctl);
 
     hw->mac.ops.config_collision_dist(hw);
@@ -635,7 +655,7 @@ void IntelMausi::intelConfigureTx(struct e1000_adapter *adapter)
 void IntelMausi::intelSetupRxControl(struct e1000_adapter *adapter)
 {
     struct e1000_hw *hw = &adapter->hw;
-    u32 rctl, rfctl;
+    u32 rctl, rfctl, psrctl = 0;
 
     /* Workaround Si errata on PCHx - configure jumbo frame flow.
      * If jumbo frames not set, program related MAC/PHY registers
@@ -730,6 +750,29 @@ void IntelMausi::intelSetupRxControl(struct e1000_adapter *adapter)
         rfctl |= E1000_RFCTL_EXTEN;
     }
 
+    /* Configure the header buffer and the payload pages of packet split. */
+    if (rxPacketSplit) {
+        psrctl = kRxPSHdrBufSize >> E1000_PSRCTL_BSIZE0_SHIFT;
+
+        switch (rxPSNumPages) {
+            case 3:
+                psrctl |= PAGE_SIZE << E1000_PSRCTL_BSIZE3_SHIFT;
+                /* fall through */
+            case 2:
+                psrctl |= PAGE_SIZE << E1000_PSRCTL_BSIZE2_SHIFT;
+                /* fall through */
+            case 1:
+                psrctl |= PAGE_SIZE >> E1000_PSRCTL_BSIZE1_SHIFT;
+                break;
+        }
+        rctl |= E1000_RCTL_DTYP_PS;
+
+        /* Malformed IPv6 extension headers can hang the receiver. */
+        rfctl |= (E1000_RFCTL_IPV6_EX_DIS | E1000_RFCTL_NEW_IPV6_EXT_DIS);
+    } else {
+        rctl &= ~E1000_RCTL_DTYP_PS;
+    }
+    intelWriteMem32(E1000_PSRCTL, psrctl);
     intelWriteMem32(E1000_RFCTL, rfctl);
 
     intelWriteMem32(E1000_RCTL, rctl);
@@ -750,7 +793,7 @@ void IntelMausi::intelConfigureRx(struct e1000_adapter *adapter)
 {
     //struct e1000_hw *hw = &adapter->hw;
     u64 rdba = rxPhyAddr;
-    u32 rctl, rxcsum, ctrl_ext, rdlen = kRxDescSize;
+    u32 rctl, rxcsum, ctrl_ext, rdlen = (rxPacketSplit) ? kRxPSDescSize(numRxDesc) : kRxDescSize(numRxDesc);
 
     /* disable receives while setting up the descriptors */
     rctl = intelReadMem32(E1000_RCTL);
@@ -799,9 +842,9 @@ void IntelMausi::intelConfigureRx(struct e1000_adapter *adapter)
     intelWriteMem32(E1000_RDH(0), 0);
     intelWriteMem32(E1000_RDT(0), 0);
     if (adapterData.flags2 & FLAG2_PCIM2PCI_ARBITER_WA)
-        intelUpdateRxDescTail(kRxLastDesc);
+        intelUpdateRxDescTail(rxDescMask);
     else
-        intelWriteMem32(E1000_RDT(0), kRxLastDesc);
+        intelWriteMem32(E1000_RDT(0), rxDescMask);
 
     rxCleanedCount = rxNextDescIndex = 0;
 
@@ -1245,6 +1288,82 @@ void IntelMausi::intelResetAdaptive(struct e1000_hw *hw)
 }
 
 
+/**
+ *  intelResetITR - Start adaptive interrupt throttling
+ *
+ *  Called on link up at 1000 Mbit/s. Returns the ITR register value
+ *  of the initial low latency class.
+ */
+UInt32 IntelMausi::intelResetITR()
+{
+    itrRxClass = itrTxClass = kItrLowLatency;
+    itrRxPackets = itrRxBytes = 0;
+    itrTxPackets = itrTxBytes = 0;
+    itrRate = kItrRateLow;
+
+    return kItrRegValue(itrRate);
+}
+
+
+/**
+ *  intelUpdateITR - Adapt the interrupt throttle rate
+ *
+ *  Classifies the rx and tx traffic since the last interrupt and moves
+ *  the interrupt rate towards the more bulky of both classes. The tx
+ *  traffic is counted when it is queued by the output path which may
+ *  run concurrently, so that only the counts taken are subtracted.
+ *
+ *  Reference: e1000_set_itr
+ */
+void IntelMausi::intelUpdateITR()
+{
+    SInt32 txPackets = itrTxPackets;
+    SInt32 txBytes = itrTxBytes;
+    UInt32 itrClass;
+    UInt32 newRate;
+
+    /* The fixed rates apply at 10 and 100 Mbit/s. */
+    if (!linkUp || (adapterData.link_speed != SPEED_1000))
+        goto reset;
+
+#ifdef __PRIVATE_SPI__
+    /* There are no rx interrupts in polling mode. */
+    if (polling)
+        goto reset;
+#endif /* __PRIVATE_SPI__ */
+
+    itrRxClass = intelItrClass(itrRxClass, itrRxPackets, itrRxBytes);
+    itrTxClass = intelItrClass(itrTxClass, txPackets, txBytes);
+    itrClass = (itrRxClass > itrTxClass) ? itrRxClass : itrTxClass;
+
+    switch (itrClass) {
+        case kItrLowestLatency:
+            drvStats.itrLowestIntervals++;
+            break;
+
+        case kItrLowLatency:
+            drvStats.itrLowIntervals++;
+            break;
+
+        default:
+            drvStats.itrBulkIntervals++;
+            break;
+    }
+    newRate = intelItrNextRate(itrRate, itrClass);
+
+    if (newRate != itrRate) {
+        itrRate = newRate;
+        intelWriteMem32(E1000_ITR, kItrRegValue(itrRate));
+        drvStats.itrUpdates++;
+    }
+
+reset:
+    itrRxPackets = itrRxBytes = 0;
+    OSAddAtomic(-txPackets, &itrTxPackets);
+    OSAddAtomic(-txBytes, &itrTxBytes);
+}
+
+
 /**
  *  intelUpdateAdaptive - Update Adaptive Interframe Spacing
  *  @hw: pointer to the HW structure
@@ -1319,6 +1438,37 @@ void IntelMausi::intelVlanStripEnable(struct e1000_adapter *adapter)
 }
 
 
+/**
+ * intelVlanFilterSetup - program the VLAN filter table
+ * @adapter: board private structure to initialize
+ *
+ * The filter is only enabled with a non-empty list of VLAN IDs
+ * and stays off in promiscuous mode.
+ *
+ * Reference: e1000e_vlan_filter_enable, e1000e_vlan_filter_disable
+ */
+void IntelMausi::intelVlanFilterSetup(struct e1000_adapter *adapter)
+{
+    struct e1000_hw *hw = &adapter->hw;
+    u32 rctl;
+    u32 i;
+
+    if (vlanFilterCount) {
+        for (i = 0; i < kVlanFilterWords; i++)
+            e1000_write_vfta_generic(hw, i, vlanFilterTable[i]);
+    } else {
+        e1000_clear_vfta_generic(hw);
+    }
+    rctl = intelReadMem32(E1000_RCTL);
+    rctl &= ~(E1000_RCTL_VFE | E1000_RCTL_CFIEN);
+
+    if (vlanFilterCount && !promiscusMode)
+        rctl |= E1000_RCTL_VFE;
+
+    intelWriteMem32(E1000_RCTL, rctl);
+}
+
+
 /**
  * intelRssKeyFill - helper to fill RSS key hash
  * @buffer: buffer to fill
@@ -1376,6 +1526,27 @@ void IntelMausi::intelSetupRssHash(struct e1000_adapter *adapter)
     intelWriteMem32(E1000_MRQC, mrqc);
 }
 
+#ifdef DEBUG
+
+/*
+ * Compare the hardware's hash of a TCP/IPv4 packet with the software
+ * reference using the key programmed in intelSetupRssHash().
+ */
+void IntelMausi::intelVerifyRssHash(mbuf_t m, UInt32 hash)
+{
+    UInt8 input[kRssInputLenTCPIPv4];
+
+    if (!intelRssInputTCPIPv4((UInt8 *)mbuf_data(m), (UInt32)mbuf_len(m), input))
+        return;
+
+    if (intelToeplitzHash(rssHashKey, input, kRssInputLenTCPIPv4) != hash) {
+        DebugLog("[IntelMausi]: RSS hash mismatch 0x%08x.\n", hash);
+        drvStats.rxHashMismatches++;
+    }
+}
+
+#endif /* DEBUG */
+
 
 /**
  * intelRestart
@@ -1546,7 +1717,7 @@ void IntelMausi::intelFlushTxRing(struct e1000_adapter *adapter)
 
     OSAddAtomic(-1, &txNumFreeDesc);
     desc = &txDescArray[txNextDescIndex++];
-    txNextDescIndex &= kTxDescMask;
+    txNextDescIndex &= txDescMask;
 
     desc->buffer_addr = OSSwapHostToLittleInt64(txPhyAddr);
     desc->lower.data = OSSwapHostToLittleInt32(txd_lower | size);
@@ -0,0 +1,130 @@
+/* IntelMausiITR.h -- Adaptive interrupt throttling.
+ *
+ * Copyright (c) 2014 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * The classification of interrupt intervals and the choice of the next
+ * interrupt rate don't depend on the driver's state. They are shared with
+ * the user space tests in Tests/ which compare them with Linux's e1000e.
+ */
+
+#ifndef _INTELMAUSIITR_H
+#define _INTELMAUSIITR_H
+
+/*
+ * Adaptive interrupt throttling at 1000 Mbit/s. Each interrupt interval
+ * is classified by its packets and bytes and the interrupt rate follows
+ * the class (rates in interrupts per second).
+ */
+enum {
+    kItrLowestLatency = 0,
+    kItrLowLatency,
+    kItrBulkLatency
+};
+
+#define kItrRateLowest          70000
+#define kItrRateLow             20000
+#define kItrRateBulk            4000
+#define kItrRegValue(rate)      (3906250 / (rate))
+
+/**
+ *  intelItrClass - Classify an interrupt interval
+ *  @itrClass: class of the previous interval
+ *  @packets: packets since the last interrupt
+ *  @bytes: bytes since the last interrupt
+ *
+ *  Reference: e1000_update_itr
+ */
+static inline UInt32 intelItrClass(UInt32 itrClass, UInt32 packets, UInt32 bytes)
+{
+    UInt32 result = itrClass;
+
+    if (packets == 0)
+        goto done;
+
+    switch (itrClass) {
+        case kItrLowestLatency:
+            /* handle TSO and jumbo frames */
+            if (bytes / packets > 8000)
+                result = kItrBulkLatency;
+            else if ((packets < 5) && (bytes > 512))
+                result = kItrLowLatency;
+            break;
+
+        case kItrLowLatency:
+            if (bytes > 10000) {
+                /* this if handles the TSO accounting */
+                if (bytes / packets > 8000)
+                    result = kItrBulkLatency;
+                else if ((packets < 10) || ((bytes / packets) > 1200))
+                    result = kItrBulkLatency;
+                else if (packets > 35)
+                    result = kItrLowestLatency;
+            } else if (bytes / packets > 2000) {
+                result = kItrBulkLatency;
+            } else if ((packets <= 2) && (bytes < 512)) {
+                result = kItrLowestLatency;
+            }
+            break;
+
+        case kItrBulkLatency:
+            if (bytes > 25000) {
+                if (packets > 35)
+                    result = kItrLowLatency;
+            } else if (bytes < 6000) {
+                result = kItrLowLatency;
+            }
+            break;
+    }
+
+done:
+    return result;
+}
+
+/**
+ *  intelItrNextRate - Get the interrupt rate of the next interval
+ *  @itrRate: current interrupt rate
+ *  @itrClass: class of the traffic
+ *
+ *  The rate of the class is taken over at once when it's lower than the
+ *  current one. Raising it is done in steps in order to bias it towards
+ *  bulk.
+ *
+ *  Reference: e1000_set_itr
+ */
+static inline UInt32 intelItrNextRate(UInt32 itrRate, UInt32 itrClass)
+{
+    UInt32 newRate;
+
+    switch (itrClass) {
+        case kItrLowestLatency:
+            newRate = kItrRateLowest;
+            break;
+
+        case kItrLowLatency:
+            newRate = kItrRateLow;
+            break;
+
+        default:
+            newRate = kItrRateBulk;
+            break;
+    }
+    if (newRate > itrRate)
+        newRate = ((itrRate + (newRate >> 2)) < newRate) ? (itrRate + (newRate >> 2)) : newRate;
+
+    return newRate;
+}
+
+#endif /* _INTELMAUSIITR_H */
@@ -0,0 +1,302 @@
+/* IntelMausiLRO.h -- Software receive coalescing.
+ *
+ * Copyright (c) 2014 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * The coalescing engine only uses the mbuf KPI and its flow table. It is
+ * shared with the user space tests in Tests/ which replay captures through
+ * it on top of a model of the mbuf KPI.
+ */
+
+#ifndef _INTELMAUSILRO_H
+#define _INTELMAUSILRO_H
+
+/*
+ * Software receive coalescing of TCP/IPv4 segments. In-order segments of
+ * up to kRxLroNumFlows flows are merged into the first segment of their
+ * flow which is handed up at the end of each rxInterrupt() run.
+ */
+#define kRxLroNumFlows          8
+#define kRxLroFlowMask          (kRxLroNumFlows - 1)
+#define kRxLroMaxLen            IP_MAXPACKET
+
+/* A TCP flow collected by software receive coalescing. */
+struct intelLroFlow {
+    mbuf_t head;            /* first segment with the headers */
+    mbuf_t tail;            /* last mbuf of the chain */
+    struct ip *ip;          /* headers in the first segment */
+    struct tcphdr *tcp;
+    UInt32 *ts;             /* timestamp option or NULL */
+    UInt32 hash;
+    UInt32 nextSeq;
+    UInt32 len;             /* IP length of the merged packet */
+    UInt32 segs;
+};
+
+/* The active flows and the coalescing statistics. */
+struct intelLroTable {
+    struct intelLroFlow flows[kRxLroNumFlows];
+    UInt32 nextEvict;
+    UInt64 hits;            /* segments merged into a flow */
+    UInt64 misses;          /* flows started */
+    UInt64 evictions;       /* flows flushed early because the table was full */
+    UInt64 flushes;         /* flows handed up */
+    UInt64 segments;        /* segments handed up in those flows */
+};
+
+/* Fix up the headers of a flow and return its head for input. */
+static inline mbuf_t intelLroFlush(struct intelLroTable *lro, struct intelLroFlow *flow)
+{
+    mbuf_t m = flow->head;
+    UInt16 *w;
+    UInt32 sum = 0;
+    UInt32 i;
+
+    if (!m)
+        goto done;
+
+    if (flow->segs > 1) {
+        flow->ip->ip_len = htons(flow->len);
+        flow->ip->ip_sum = 0;
+
+        for (i = 0, w = (UInt16 *)flow->ip; i < (sizeof(struct ip) >> 1); i++)
+            sum += w[i];
+
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum += (sum >> 16);
+        flow->ip->ip_sum = (UInt16)~sum;
+
+        mbuf_pkthdr_setlen(m, ETH_HLEN + flow->len);
+    }
+    lro->flushes++;
+    lro->segments += flow->segs;
+    bzero(flow, sizeof(struct intelLroFlow));
+
+done:
+    return m;
+}
+
+/*
+ * Try to merge a received packet into one of the active TCP flows. Returns
+ * a list of packets linked by their nextpkt pointers which are ready to be
+ * handed up, or NULL in case the packet has been held back. A packet which
+ * can't be merged is handed up behind its flow in order to preserve the
+ * order of the stream.
+ */
+static inline mbuf_t intelLroReceive(struct intelLroTable *lro, mbuf_t m, UInt32 status, UInt32 hash)
+{
+    struct intelLroFlow *flow = NULL;
+    struct ether_header *eh;
+    struct ip *ip4;
+    struct tcphdr *tcp;
+    UInt32 *ts = NULL;
+    mbuf_t out = NULL;
+    mbuf_t n;
+    UInt32 ipLen, hdrLen, tcpHdrLen, payload, seq, i;
+    UInt16 vlanTag = 0, tag;
+    UInt8 flags;
+
+    if (mbuf_get_vlan_tag(m, &vlanTag))
+        vlanTag = 0;
+
+    eh = (struct ether_header *)mbuf_data(m);
+    ip4 = (struct ip *)((UInt8 *)eh + ETH_HLEN);
+
+    /* Only TCP/IPv4 can belong to a flow. */
+    if (mbuf_len(m) < (ETH_HLEN + sizeof(struct ip)))
+        goto input;
+
+    if ((eh->ether_type != htons(ETHERTYPE_IP)) || (ip4->ip_v != IPVERSION) ||
+        (ip4->ip_hl < (sizeof(struct ip) >> 2)) || (ip4->ip_p != IPPROTO_TCP))
+        goto input;
+
+    tcp = (struct tcphdr *)((UInt8 *)ip4 + (ip4->ip_hl << 2));
+
+    if (mbuf_len(m) < (ETH_HLEN + (ip4->ip_hl << 2) + sizeof(struct tcphdr)))
+        goto input;
+
+    /* Look up the flow first so that it's flushed ahead of packets which can't be merged. */
+    for (i = 0; i < kRxLroNumFlows; i++) {
+        flow = &lro->flows[i];
+
+        if (!flow->head || (hash && flow->hash && (hash != flow->hash)))
+            continue;
+
+        if ((flow->ip->ip_src.s_addr == ip4->ip_src.s_addr) && (flow->ip->ip_dst.s_addr == ip4->ip_dst.s_addr) &&
+            (flow->tcp->th_sport == tcp->th_sport) && (flow->tcp->th_dport == tcp->th_dport)) {
+            if (mbuf_get_vlan_tag(flow->head, &tag))
+                tag = 0;
+
+            if (tag == vlanTag)
+                break;
+        }
+    }
+    if (i == kRxLroNumFlows)
+        flow = NULL;
+
+    /* Segments with IP options are handed up behind their flow. */
+    if (ip4->ip_hl != (sizeof(struct ip) >> 2))
+        goto flush;
+
+    /* Only segments with valid checksums. */
+    if ((status & (E1000_RXDEXT_STATERR_IPE | E1000_RXDEXT_STATERR_TCPE)) ||
+        !(status & E1000_RXD_STAT_IPPCS) || !(status & E1000_RXD_STAT_TCPCS))
+        goto flush;
+
+    /* No fragments and no congestion experienced. */
+    if ((ip4->ip_off & htons(IP_MF | IP_OFFMASK)) || ((ip4->ip_tos & IPTOS_ECN_MASK) == IPTOS_ECN_CE))
+        goto flush;
+
+    ipLen = ntohs(ip4->ip_len);
+    tcpHdrLen = tcp->th_off << 2;
+    hdrLen = sizeof(struct ip) + tcpHdrLen;
+
+    if ((ETH_HLEN + ipLen) != mbuf_pkthdr_len(m) || (ipLen <= hdrLen) || (mbuf_len(m) < (ETH_HLEN + hdrLen)))
+        goto flush;
+
+    /* The only option we accept is an aligned timestamp. */
+    if (tcpHdrLen == (sizeof(struct tcphdr) + TCPOLEN_TSTAMP_APPA)) {
+        ts = (UInt32 *)(tcp + 1);
+
+        if ((*ts != htonl(TCPOPT_TSTAMP_HDR)) || !ts[2])
+            goto flush;
+
+    } else if (tcpHdrLen != sizeof(struct tcphdr)) {
+        goto flush;
+    }
+    flags = tcp->th_flags;
+
+    if ((flags & ~TH_PUSH) != TH_ACK)
+        goto flush;
+
+    payload = ipLen - hdrLen;
+    seq = ntohl(tcp->th_seq);
+
+    if (!flow)
+        goto newFlow;
+
+    /* Check that the segment continues the flow. */
+    if ((seq != flow->nextSeq) || ((flow->len + payload) > kRxLroMaxLen) ||
+        ((SInt32)(ntohl(tcp->th_ack) - ntohl(flow->tcp->th_ack)) < 0) || (!ts != !flow->ts) ||
+        (ts && ((SInt32)(ntohl(ts[1]) - ntohl(flow->ts[1])) < 0))) {
+        out = intelLroFlush(lro, flow);
+        goto newFlow;
+    }
+    /* The segment's mbufs become part of the flow's chain. */
+    if (mbuf_setflags_mask(m, 0, MBUF_PKTHDR)) {
+        DebugLog("[IntelMausi]: mbuf_setflags_mask() failed. Flushing flow.\n");
+        goto flush;
+    }
+    /* Take over the latest ack, window and timestamp. */
+    flow->tcp->th_ack = tcp->th_ack;
+    flow->tcp->th_win = tcp->th_win;
+    flow->tcp->th_flags |= flags;
+
+    if (ts) {
+        flow->ts[1] = ts[1];
+        flow->ts[2] = ts[2];
+    }
+    /* Strip the headers and append the payload to the flow. */
+    mbuf_adj(m, ETH_HLEN + hdrLen);
+
+    while (!mbuf_len(m))
+        m = mbuf_free(m);
+
+    mbuf_setnext(flow->tail, m);
+
+    for (n = m; mbuf_next(n); n = mbuf_next(n))
+        ;
+
+    flow->tail = n;
+    flow->nextSeq += payload;
+    flow->len += payload;
+    flow->segs++;
+    lro->hits++;
+
+    /* The sender wants the data to be delivered now. */
+    if (flags & TH_PUSH)
+        out = intelLroFlush(lro, flow);
+
+done:
+    return out;
+
+newFlow:
+    if (flags & TH_PUSH)
+        goto input;
+
+    if (!flow) {
+        for (i = 0; i < kRxLroNumFlows; i++) {
+            if (!lro->flows[i].head)
+                break;
+        }
+        if (i == kRxLroNumFlows) {
+            i = lro->nextEvict;
+            lro->nextEvict = (lro->nextEvict + 1) & kRxLroFlowMask;
+            out = intelLroFlush(lro, &lro->flows[i]);
+            lro->evictions++;
+        }
+        flow = &lro->flows[i];
+    }
+    for (n = m; mbuf_next(n); n = mbuf_next(n))
+        ;
+
+    flow->head = m;
+    flow->tail = n;
+    flow->ip = ip4;
+    flow->tcp = tcp;
+    flow->ts = ts;
+    flow->hash = hash;
+    flow->nextSeq = seq + payload;
+    flow->len = ipLen;
+    flow->segs = 1;
+    lro->misses++;
+    goto done;
+
+flush:
+    if (flow)
+        out = intelLroFlush(lro, flow);
+
+input:
+    /* Hand up the packet behind a flushed flow to preserve ordering. */
+    if (out)
+        mbuf_setnextpkt(out, m);
+    else
+        out = m;
+
+    goto done;
+}
+
+/* Flush all active flows and return them as a list of packets. */
+static inline mbuf_t intelLroFlushAll(struct intelLroTable *lro)
+{
+    mbuf_t head = NULL;
+    mbuf_t tail = NULL;
+    mbuf_t m;
+    UInt32 i;
+
+    for (i = 0; i < kRxLroNumFlows; i++) {
+        if ((m = intelLroFlush(lro, &lro->flows[i]))) {
+            if (tail)
+                mbuf_setnextpkt(tail, m);
+            else
+                head = m;
+
+            tail = m;
+        }
+    }
+    return head;
+}
+
+#endif /* _INTELMAUSILRO_H */
@@ -0,0 +1,80 @@
+/* IntelMausiRSS.h -- Software reference of the RSS hash.
+ *
+ * Copyright (c) 2014 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * Debug builds check the hash reported by the hardware against this
+ * reference. It is shared with the user space tests in Tests/ which
+ * verify it against the vectors of Microsoft's RSS specification.
+ */
+
+#ifndef _INTELMAUSIRSS_H
+#define _INTELMAUSIRSS_H
+
+/* Hash input of TCP/IPv4: addresses and ports in network byte order. */
+#define kRssInputLenIPv4    8
+#define kRssInputLenTCPIPv4 12
+
+/*
+ * Toeplitz hash of len bytes of data as computed by the hardware.
+ * The key must be at least len + 4 bytes long.
+ */
+static inline UInt32 intelToeplitzHash(const UInt8 *key, const UInt8 *data, UInt32 len)
+{
+    UInt32 hash = 0;
+    UInt32 v = (key[0] << 24) | (key[1] << 16) | (key[2] << 8) | key[3];
+    UInt32 i, b;
+
+    for (i = 0; i < len; i++) {
+        for (b = 0; b < 8; b++) {
+            if (data[i] & (0x80 >> b))
+                hash ^= v;
+
+            v <<= 1;
+
+            if (key[i + 4] & (0x80 >> b))
+                v |= 1;
+        }
+    }
+    return hash;
+}
+
+/*
+ * Get the hash input of a TCP/IPv4 frame whose first len bytes are in
+ * data. Returns false in case the frame is too short or isn't IPv4.
+ */
+static inline bool intelRssInputTCPIPv4(const UInt8 *data, UInt32 len, UInt8 *input)
+{
+    const struct ip *ip4 = (const struct ip *)&data[ETH_HLEN];
+    UInt32 l4Offset;
+    bool result = false;
+
+    if ((len < ETH_HLEN + sizeof(struct ip)) || (((data[12] << 8) | data[13]) != ETHERTYPE_IP))
+        goto done;
+
+    l4Offset = ETH_HLEN + (ip4->ip_hl << 2);
+
+    if (len < l4Offset + 4)
+        goto done;
+
+    memcpy(input, &ip4->ip_src, 8);
+    memcpy(&input[8], &data[l4Offset], 4);
+    result = true;
+
+done:
+    return result;
+}
+
+#endif /* _INTELMAUSIRSS_H */
@@ -66,7 +66,14 @@ void IntelMausi::getParams()
     OSString *versionString;
     OSNumber *num;
     OSBoolean *csoV6;
+    OSBoolean *tso;
     OSBoolean *wom;
+    OSBoolean *bql;
+    OSBoolean *prio;
+    OSBoolean *split;
+    OSBoolean *lro;
+    OSBoolean *aitr;
+    OSArray *vlans;
     UInt32 newIntrRate10;
     UInt32 newIntrRate100;
     UInt32 newIntrRate1000;
@@ -81,11 +88,148 @@ void IntelMausi::getParams()
 
         DebugLog("[IntelMausi]: TCP/IPv6 checksum offload %s.\n", enableCSO6 ? onName : offName);
 
+        tso = OSDynamicCast(OSBoolean, params->getObject(kEnableTSO4Name));
+        enableTSO4 = (tso) ? tso->getValue() : false;
+
+        DebugLog("[IntelMausi]: TCP/IPv4 segmentation offload %s.\n", enableTSO4 ? onName : offName);
+
+        /* TSO6 depends on TCP/IPv6 checksum offload. */
+        tso = OSDynamicCast(OSBoolean, params->getObject(kEnableTSO6Name));
+        enableTSO6 = (tso && enableCSO6) ? tso->getValue() : false;
+
+        DebugLog("[IntelMausi]: TCP/IPv6 segmentation offload %s.\n", enableTSO6 ? onName : offName);
+
         wom = OSDynamicCast(OSBoolean, params->getObject(kEnableWoMName));
         enableWoM = (wom) ? wom->getValue() : false;
 
         DebugLog("[IntelMausi]: Wake on address match %s.\n", enableWoM ? onName : offName);
 
+        /* Get the size limit for packets sent from the bounce buffer. */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxCopybreakName));
+        txCopybreak = kTxCopybreakDefault;
+
+        if (num)
+            txCopybreak = num->unsigned32BitValue();
+
+        if (txCopybreak > kTxBounceSlotSize)
+            txCopybreak = kTxBounceSlotSize;
+
+        DebugLog("[IntelMausi]: TX copybreak %u bytes.\n", txCopybreak);
+
+        /* Get the initial rx copybreak, 0 disables copying. */
+        num = OSDynamicCast(OSNumber, params->getObject(kRxCopybreakName));
+        rxCopybreakInit = kRxCopybreakDefault;
+
+        if (num) {
+            rxCopybreakInit = num->unsigned32BitValue();
+
+            if (rxCopybreakInit > kRxCopybreakMax)
+                rxCopybreakInit = kRxCopybreakMax;
+            else if (rxCopybreakInit && (rxCopybreakInit < kRxCopybreakMin))
+                rxCopybreakInit = kRxCopybreakMin;
+        }
+        rxCopybreak = rxCopybreakInit;
+
+        DebugLog("[IntelMausi]: RX copybreak %u bytes.\n", rxCopybreak);
+
+        /* Get the number of packets received per interrupt. */
+        num = OSDynamicCast(OSNumber, params->getObject(kRxBudgetName));
+        rxBudget = kRxBudgetDefault;
+
+        if (num) {
+            rxBudget = num->unsigned32BitValue();
+
+            if (rxBudget > kRxBudgetMax)
+                rxBudget = kRxBudgetMax;
+            else if (rxBudget < kRxBudgetMin)
+                rxBudget = kRxBudgetMin;
+        }
+        DebugLog("[IntelMausi]: RX budget %u packets.\n", rxBudget);
+
+        /* Get the VLAN IDs to let through the hardware filter. */
+        vlans = OSDynamicCast(OSArray, params->getObject(kVlanFilterName));
+
+        if (vlans && !intelParseVlanFilter(vlans, vlanFilterTable, &vlanFilterCount)) {
+            bzero(&vlanFilterTable, sizeof(vlanFilterTable));
+            vlanFilterCount = 0;
+        }
+        DebugLog("[IntelMausi]: VLAN filter with %u IDs.\n", vlanFilterCount);
+
+        /* Get the ring sizes. */
+        num = OSDynamicCast(OSNumber, params->getObject(kNumTxDescName));
+        numTxDesc = kNumTxDescDefault;
+
+        if (num && kIsValidRingSize(num->unsigned32BitValue()))
+            numTxDesc = num->unsigned32BitValue();
+
+        if ((enableTSO4 || enableTSO6) && (numTxDesc < kMinNumTSODesc)) {
+            IOLog("[IntelMausi]: TSO needs at least %u tx descriptors.\n", kMinNumTSODesc);
+            numTxDesc = kMinNumTSODesc;
+        }
+
+        num = OSDynamicCast(OSNumber, params->getObject(kNumRxDescName));
+        numRxDesc = kNumRxDescDefault;
+
+        if (num && kIsValidRingSize(num->unsigned32BitValue()))
+            numRxDesc = num->unsigned32BitValue();
+
+        DebugLog("[IntelMausi]: %u tx and %u rx descriptors.\n", numTxDesc, numRxDesc);
+
+        bql = OSDynamicCast(OSBoolean, params->getObject(kEnableTxBQLName));
+        enableTxBQL = (bql) ? bql->getValue() : true;
+
+        DebugLog("[IntelMausi]: TX byte queue limit %s.\n", enableTxBQL ? onName : offName);
+
+        prio = OSDynamicCast(OSBoolean, params->getObject(kEnableTxPrioQueueName));
+        enableTxPrioQueue = (prio) ? prio->getValue() : false;
+
+        DebugLog("[IntelMausi]: TX priority queue %s.\n", enableTxPrioQueue ? onName : offName);
+
+        split = OSDynamicCast(OSBoolean, params->getObject(kEnableRxPacketSplitName));
+        enableRxPacketSplit = (split) ? split->getValue() : false;
+
+        DebugLog("[IntelMausi]: RX packet split %s.\n", enableRxPacketSplit ? onName : offName);
+
+        lro = OSDynamicCast(OSBoolean, params->getObject(kEnableRxLROName));
+        enableRxLRO = (lro) ? lro->getValue() : false;
+
+        DebugLog("[IntelMausi]: RX coalescing %s.\n", enableRxLRO ? onName : offName);
+
+        /* Get the tx reclaim watermark (in percent) and timeout (in us). */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxReclaimWatermarkName));
+        txReclaimPercent = kTxReclaimWatermarkDefault;
+
+        if (num)
+            txReclaimPercent = num->unsigned32BitValue();
+
+        if (txReclaimPercent > 100)
+            txReclaimPercent = 100;
+
+        num = OSDynamicCast(OSNumber, params->getObject(kTxReclaimTimeoutName));
+        txReclaimTimeout = kTxReclaimTimeoutDefault;
+
+        if (num)
+            txReclaimTimeout = num->unsigned32BitValue();
+
+        if (!txReclaimTimeout || (txReclaimTimeout > kTxReclaimTimeoutMax))
+            txReclaimTimeout = kTxReclaimTimeoutDefault;
+
+        DebugLog("[IntelMausi]: TX reclaim watermark %u%%, timeout %uus.\n", txReclaimPercent, txReclaimTimeout);
+
+        /* Get the tx hang timeout in ms. 0 falls back to the deadlock check in timerAction(). */
+        num = OSDynamicCast(OSNumber, params->getObject(kTxHangTimeoutName));
+        txHangTimeout = kTxHangTimeoutDefault;
+
+        if (num)
+            txHangTimeout = num->unsigned32BitValue();
+
+        if (txHangTimeout && (txHangTimeout < kTxHangTimeoutMin))
+            txHangTimeout = kTxHangTimeoutMin;
+        else if (txHangTimeout > kTxHangTimeoutMax)
+            txHangTimeout = kTxHangTimeoutMax;
+
+        DebugLog("[IntelMausi]: TX hang timeout %ums.\n", txHangTimeout);
+
         /* Get maximum interrupt rate for 10M. */
         num = OSDynamicCast(OSNumber, params->getObject(kIntrRate10Name));
         newIntrRate10 = 3000;
@@ -128,6 +272,12 @@ void IntelMausi::getParams()
 
         intrThrValue1000 = (3906250 / (newIntrRate1000 + 1));
 
+        /* Replaces the fixed rate at 1000M. */
+        aitr = OSDynamicCast(OSBoolean, params->getObject(kEnableAdaptiveITRName));
+        enableAdaptiveITR = (aitr) ? aitr->getValue() : false;
+
+        DebugLog("[IntelMausi]: Adaptive interrupt throttling %s.\n", enableAdaptiveITR ? onName : offName);
+
         /* Get rxAbsTime10 from config data */
         num = OSDynamicCast(OSNumber, params->getObject(kRxAbsTime10Name));
 
@@ -198,7 +348,15 @@ void IntelMausi::getParams()
     } else {
         /* Use default values in case of missing config data. */
         enableCSO6 = false;
+        enableTSO4 = false;
+        enableTSO6 = false;
         enableWoM = false;
+        txCopybreak = kTxCopybreakDefault;
+        rxCopybreakInit = rxCopybreak = kRxCopybreakDefault;
+        rxBudget = kRxBudgetDefault;
+        numTxDesc = kNumTxDescDefault;
+        numRxDesc = kNumRxDescDefault;
+        enableTxBQL = true;
         newIntrRate10 = 3000;
         newIntrRate100 = 5000;
         newIntrRate1000 = 7000;
@@ -304,19 +462,56 @@ bool IntelMausi::initEventSources(IOService *provider)
     }
     workLoop->addEventSource(interruptSource);
 
+    /* Without a provider the event source is triggered by software. */
+    rxBudgetSource = IOInterruptEventSource::interruptEventSource(this, OSMemberFunctionCast(IOInterruptEventSource::Action, this, &IntelMausi::rxBudgetAction));
+
+    if (!rxBudgetSource) {
+        IOLog("[IntelMausi]: Failed to create IOInterruptEventSource.\n");
+        goto error2;
+    }
+    workLoop->addEventSource(rxBudgetSource);
+
     timerSource = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &IntelMausi::timerAction));
 
     if (!timerSource) {
         IOLog("[IntelMausi]: Failed to create IOTimerEventSource.\n");
-        goto error2;
+        goto error3;
     }
     workLoop->addEventSource(timerSource);
 
+    txReclaimTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &IntelMausi::txReclaimTimerAction));
+
+    if (!txReclaimTimer) {
+        IOLog("[IntelMausi]: Failed to create IOTimerEventSource.\n");
+        goto error4;
+    }
+    workLoop->addEventSource(txReclaimTimer);
+
+    txHangTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &IntelMausi::txHangTimerAction));
+
+    if (!txHangTimer) {
+        IOLog("[IntelMausi]: Failed to create IOTimerEventSource.\n");
+        goto error5;
+    }
+    workLoop->addEventSource(txHangTimer);
+
     result = true;
 
 done:
     return result;
 
+error5:
+    workLoop->removeEventSource(txReclaimTimer);
+    RELEASE(txReclaimTimer);
+
+error4:
+    workLoop->removeEventSource(timerSource);
+    RELEASE(timerSource);
+
+error3:
+    workLoop->removeEventSource(rxBudgetSource);
+    RELEASE(rxBudgetSource);
+
 error2:
     workLoop->removeEventSource(interruptSource);
     RELEASE(interruptSource);
@@ -332,20 +527,46 @@ bool IntelMausi::setupDMADescriptors()
 {
     IODMACommand::Segment64 seg;
     IOPhysicalSegment rxSegment;
-    mbuf_t spareMbuf[kRxNumSpareMbufs];
     mbuf_t m;
     UInt64 offset = 0;
     UInt32 numSegs = 1;
+    UInt32 rxRingSize;
     UInt32 i;
     UInt32 n;
     bool result = false;
 
+    txDescMask = numTxDesc - 1;
+    rxDescMask = numRxDesc - 1;
+
+    /* Packet split replaces the large receive buffers of jumbo frames. */
+    rxPacketSplit = enableRxPacketSplit && (rxBufferSize > kRxBufferPktSize);
+    rxRingSize = (rxPacketSplit) ? kRxPSDescSize(numRxDesc) : kRxDescSize(numRxDesc);
+
+    /* A watermark of 0 releases completed packets on every interrupt. */
+    txReclaimWatermark = 0;
+
+    if (txReclaimPercent)
+        txReclaimWatermark = max((numTxDesc * txReclaimPercent) / 100, kTxReclaimMinWatermark);
+
+    /* Allocate the buffer info arrays of both rings. */
+    txBufArray = (struct intelTxBufferInfo *)IOMalloc(numTxDesc * sizeof(struct intelTxBufferInfo));
+
+    if (!txBufArray) {
+        IOLog("[IntelMausi]: Couldn't alloc txBufArray.\n");
+        goto done;
+    }
+    rxBufArray = (struct intelRxBufferInfo *)IOMalloc(numRxDesc * sizeof(struct intelRxBufferInfo));
+
+    if (!rxBufArray) {
+        IOLog("[IntelMausi]: Couldn't alloc rxBufArray.\n");
+        goto error0;
+    }
     /* Create transmitter descriptor array. */
-    txBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMapInhibitCache), kTxDescSize, 0xFFFFFFFFFFFFF000ULL);
+    txBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMapInhibitCache), kTxDescSize(numTxDesc), 0xFFFFFFFFFFFFF000ULL);
 
     if (!txBufDesc) {
         IOLog("[IntelMausi]: Couldn't alloc txBufDesc.\n");
-        goto done;
+        goto error0;
     }
     if (txBufDesc->prepare() != kIOReturnSuccess) {
         IOLog("[IntelMausi]: txBufDesc->prepare() failed.\n");
@@ -374,15 +595,24 @@ bool IntelMausi::setupDMADescriptors()
     txPhyAddr = seg.fIOVMAddr;
 
     /* Initialize txDescArray. */
-    bzero(txDescArray, kTxDescSize);
+    bzero(txDescArray, kTxDescSize(numTxDesc));
 
-    for (i = 0; i < kNumTxDesc; i++) {
+    for (i = 0; i < numTxDesc; i++) {
         txBufArray[i].mbuf = NULL;
         txBufArray[i].numDescs = 0;
         txBufArray[i].pad = 0;
+        txBufArray[i].bytes = 0;
+        txBufArray[i].coalesced = false;
+        txBufArray[i].time = 0;
     }
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txNumFreeDesc = numTxDesc;
+    txGSOPacket = NULL;
+    txGSONextSeg = 0;
+    txCoalesceNext = 0;
+    txCoalesceFree = kTxNumCoalesceBufs;
+    intelResetTxBQL();
+    bzero(&txContext, sizeof(txContext));
     txMbufCursor = IOMbufNaturalMemoryCursor::withSpecification(0x4000, kMaxSegs);
 
     if (!txMbufCursor) {
@@ -391,7 +621,7 @@ bool IntelMausi::setupDMADescriptors()
     }
 
     /* Create receiver descriptor array. */
-    rxBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMapInhibitCache), kRxDescSize, 0xFFFFFFFFFFFFF000ULL);
+    rxBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMapInhibitCache), rxRingSize, 0xFFFFFFFFFFFFF000ULL);
 
     if (!rxBufDesc) {
         IOLog("[IntelMausi]: Couldn't alloc rxBufDesc.\n");
@@ -427,63 +657,174 @@ bool IntelMausi::setupDMADescriptors()
     rxPhyAddr = seg.fIOVMAddr;
 
     /* Initialize rxDescArray. */
-    bzero((void *)rxDescArray, kRxDescSize);
+    bzero((void *)rxDescArray, rxRingSize);
 
-    for (i = 0; i < kNumRxDesc; i++) {
+    for (i = 0; i < numRxDesc; i++) {
         rxBufArray[i].mbuf = NULL;
         rxBufArray[i].phyAddr = 0;
     }
     rxCleanedCount = rxNextDescIndex = 0;
 
-    rxMbufCursor = IOMbufNaturalMemoryCursor::withSpecification(PAGE_SIZE, 1);
+    rxMbufCursor = IOMbufNaturalMemoryCursor::withSpecification(max(rxBufferSize, PAGE_SIZE), 1);
+    adapterData.rx_buffer_len = rxBufferSize;
 
     if (!rxMbufCursor) {
         IOLog("[IntelMausi]: Couldn't create rxMbufCursor.\n");
         goto error9;
     }
-    /* Alloc receive buffers. */
-    for (i = 0; i < kNumRxDesc; i++) {
-        m = allocatePacket(kRxBufferPktSize);
-
-        if (!m) {
-            IOLog("[IntelMausi]: Couldn't alloc receive buffer.\n");
+    if (rxPacketSplit) {
+        if (!setupRxPacketSplit())
             goto error10;
-        }
-        rxBufArray[i].mbuf = m;
+    } else {
+        /* Alloc receive buffers. */
+        for (i = 0; i < numRxDesc; i++) {
+            m = allocatePacket(rxBufferSize);
+
+            if (!m) {
+                IOLog("[IntelMausi]: Couldn't alloc receive buffer.\n");
+                goto error10;
+            }
+            rxBufArray[i].mbuf = m;
 
-        n = rxMbufCursor->getPhysicalSegments(m, &rxSegment, 1);
+            n = rxMbufCursor->getPhysicalSegments(m, &rxSegment, 1);
 
-        if ((n != 1) || (rxSegment.location & 0x07ff)) {
-            IOLog("[IntelMausi]: getPhysicalSegments() for receive buffer failed.\n");
-            goto error10;
+            if ((n != 1) || (rxSegment.location & kRxBufferAlignMask(rxBufferSize))) {
+                IOLog("[IntelMausi]: getPhysicalSegments() for receive buffer failed.\n");
+                goto error10;
+            }
+            /* We have to keep the physical address of the buffer too
+             * as descriptor write back overwrites it in the descriptor
+             * so that it must be refreshed when the descriptor is
+             * prepared for reuse.
+             */
+            rxBufArray[i].phyAddr = rxSegment.location;
+
+            rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxSegment.location);
+            rxDescArray[i].read.reserved = 0;
         }
-        /* We have to keep the physical address of the buffer too
-         * as descriptor write back overwrites it in the descriptor
-         * so that it must be refreshed when the descriptor is
-         * prepared for reuse.
-         */
-        rxBufArray[i].phyAddr = rxSegment.location;
+    }
+    /* Create the bounce buffer for software TSO, tx copybreak and coalescing. */
+    txBounceDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous), kTxBounceBufSize(numTxDesc), 0xFFFFFFFFFFFFF000ULL);
 
-        rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxSegment.location);
-        rxDescArray[i].read.reserved = 0;
+    if (!txBounceDesc) {
+        IOLog("[IntelMausi]: Couldn't alloc txBounceDesc.\n");
+        goto error10;
     }
-    /* Allocate some spare mbufs and free them in order to increase the buffer pool.
-     * This seems to avoid the replaceOrCopyPacket() errors under heavy load.
-     */
-    for (i = 0; i < kRxNumSpareMbufs; i++)
-        spareMbuf[i] = allocatePacket(kRxBufferPktSize);
+    if (txBounceDesc->prepare() != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: txBounceDesc->prepare() failed.\n");
+        goto error11;
+    }
+    txBounceArray = (UInt8 *)txBounceDesc->getBytesNoCopy();
+
+    txBounceDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1);
+
+    if (!txBounceDmaCmd) {
+        IOLog("[IntelMausi]: Couldn't alloc txBounceDmaCmd.\n");
+        goto error12;
+    }
+    if (txBounceDmaCmd->setMemoryDescriptor(txBounceDesc) != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: setMemoryDescriptor() failed.\n");
+        goto error13;
+    }
+    offset = 0;
+    numSegs = 1;
+
+    if (txBounceDmaCmd->gen64IOVMSegments(&offset, &seg, &numSegs) != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: gen64IOVMSegments() failed.\n");
+        goto error14;
+    }
+    txBouncePhyAddr = seg.fIOVMAddr;
+
+    /* Create the descriptor array of the priority ring. */
+    if (enableTxPrioQueue) {
+        txPrioBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous | kIOMapInhibitCache), kTxDescSize(kNumTxPrioDesc), 0xFFFFFFFFFFFFF000ULL);
+
+        if (!txPrioBufDesc) {
+            IOLog("[IntelMausi]: Couldn't alloc txPrioBufDesc.\n");
+            goto error14;
+        }
+        if (txPrioBufDesc->prepare() != kIOReturnSuccess) {
+            IOLog("[IntelMausi]: txPrioBufDesc->prepare() failed.\n");
+            goto error15;
+        }
+        txPrioDescArray = (struct e1000_data_desc *)txPrioBufDesc->getBytesNoCopy();
+
+        txPrioDescDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1);
+
+        if (!txPrioDescDmaCmd) {
+            IOLog("[IntelMausi]: Couldn't alloc txPrioDescDmaCmd.\n");
+            goto error16;
+        }
+        if (txPrioDescDmaCmd->setMemoryDescriptor(txPrioBufDesc) != kIOReturnSuccess) {
+            IOLog("[IntelMausi]: setMemoryDescriptor() failed.\n");
+            goto error17;
+        }
+        offset = 0;
+        numSegs = 1;
 
-    for (i = 0; i < kRxNumSpareMbufs; i++) {
-        if (spareMbuf[i])
-            freePacket(spareMbuf[i]);
+        if (txPrioDescDmaCmd->gen64IOVMSegments(&offset, &seg, &numSegs) != kIOReturnSuccess) {
+            IOLog("[IntelMausi]: gen64IOVMSegments() failed.\n");
+            goto error18;
+        }
+        txPrioPhyAddr = seg.fIOVMAddr;
+
+        bzero(txPrioDescArray, kTxDescSize(kNumTxPrioDesc));
+
+        for (i = 0; i < kNumTxPrioDesc; i++) {
+            txPrioBufArray[i].mbuf = NULL;
+            txPrioBufArray[i].numDescs = 0;
+            txPrioBufArray[i].pad = 0;
+            txPrioBufArray[i].bytes = 0;
+            txPrioBufArray[i].coalesced = false;
+        }
+        txPrioNextDescIndex = txPrioDirtyIndex = txPrioCleanBarrierIndex = 0;
+        txPrioNumFreeDesc = kNumTxPrioDesc;
+        bzero(&txPrioContext, sizeof(txPrioContext));
     }
+
+    /* Fill the pool with the buffers which replace those handed up to the stack. */
+    rxPoolBufSize = (rxPacketSplit) ? PAGE_SIZE : rxBufferSize;
+    rxPoolHead = rxPoolCount = 0;
+    intelRxPoolRefill(kRxPoolSize);
+
+    DebugLog("[IntelMausi]: %u buffers in the rx pool.\n", rxPoolCount);
     result = true;
 
 done:
     return result;
 
+error18:
+    txPrioDescDmaCmd->clearMemoryDescriptor();
+
+error17:
+    RELEASE(txPrioDescDmaCmd);
+
+error16:
+    txPrioBufDesc->complete();
+
+error15:
+    txPrioBufDesc->release();
+    txPrioDescArray = NULL;
+    txPrioBufDesc = NULL;
+
+error14:
+    txBounceDmaCmd->clearMemoryDescriptor();
+
+error13:
+    RELEASE(txBounceDmaCmd);
+
+error12:
+    txBounceDesc->complete();
+
+error11:
+    txBounceDesc->release();
+    txBounceArray = NULL;
+    txBounceDesc = NULL;
+
 error10:
-    for (i = 0; i < kNumRxDesc; i++) {
+    freeRxPacketSplit();
+
+    for (i = 0; i < numRxDesc; i++) {
         if (rxBufArray[i].mbuf) {
             freePacket(rxBufArray[i].mbuf);
             rxBufArray[i].mbuf = NULL;
@@ -503,6 +844,7 @@ error7:
 error6:
     rxBufDesc->release();
     rxDescArray = NULL;
+    rxPSDescArray = NULL;
     rxBufDesc = NULL;
 
 error5:
@@ -520,6 +862,14 @@ error2:
 error1:
     txBufDesc->release();
     txBufDesc = NULL;
+
+error0:
+    if (rxBufArray) {
+        IOFree(rxBufArray, numRxDesc * sizeof(struct intelRxBufferInfo));
+        rxBufArray = NULL;
+    }
+    IOFree(txBufArray, numTxDesc * sizeof(struct intelTxBufferInfo));
+    txBufArray = NULL;
     goto done;
 }
 
@@ -540,10 +890,42 @@ void IntelMausi::freeDMADescriptors()
     }
     RELEASE(txMbufCursor);
 
+    if (txBounceDesc) {
+        txBounceDesc->complete();
+        txBounceDesc->release();
+        txBounceArray = NULL;
+        txBounceDesc = NULL;
+        txBouncePhyAddr = 0;
+    }
+    if (txBounceDmaCmd) {
+        txBounceDmaCmd->clearMemoryDescriptor();
+        txBounceDmaCmd->release();
+        txBounceDmaCmd = NULL;
+    }
+    if (txPrioBufDesc) {
+        txPrioBufDesc->complete();
+        txPrioBufDesc->release();
+        txPrioDescArray = NULL;
+        txPrioBufDesc = NULL;
+        txPrioPhyAddr = 0;
+    }
+    if (txPrioDescDmaCmd) {
+        txPrioDescDmaCmd->clearMemoryDescriptor();
+        txPrioDescDmaCmd->release();
+        txPrioDescDmaCmd = NULL;
+    }
+    for (i = 0; i < kNumTxPrioDesc; i++) {
+        if (txPrioBufArray[i].mbuf) {
+            freePacket(txPrioBufArray[i].mbuf);
+            txPrioBufArray[i].mbuf = NULL;
+        }
+    }
+
     if (rxBufDesc) {
         rxBufDesc->complete();
         rxBufDesc->release();
         rxDescArray = NULL;
+        rxPSDescArray = NULL;
         rxBufDesc = NULL;
         rxPhyAddr = 0;
     }
@@ -552,14 +934,413 @@ void IntelMausi::freeDMADescriptors()
         rxDescDmaCmd->release();
         rxDescDmaCmd = NULL;
     }
+    intelRxPoolFree();
     RELEASE(rxMbufCursor);
+    freeRxPacketSplit();
 
-    for (i = 0; i < kNumRxDesc; i++) {
-        if (rxBufArray[i].mbuf) {
-            freePacket(rxBufArray[i].mbuf);
-            rxBufArray[i].mbuf = NULL;
+    if (rxBufArray) {
+        for (i = 0; i < numRxDesc; i++) {
+            if (rxBufArray[i].mbuf) {
+                freePacket(rxBufArray[i].mbuf);
+                rxBufArray[i].mbuf = NULL;
+            }
+        }
+        IOFree(rxBufArray, numRxDesc * sizeof(struct intelRxBufferInfo));
+        rxBufArray = NULL;
+    }
+    if (txBufArray) {
+        for (i = 0; i < numTxDesc; i++) {
+            if (txBufArray[i].mbuf) {
+                freePacket(txBufArray[i].mbuf);
+                txBufArray[i].mbuf = NULL;
+            }
+        }
+        IOFree(txBufArray, numTxDesc * sizeof(struct intelTxBufferInfo));
+        txBufArray = NULL;
+    }
+}
+
+/*
+ * Set up the buffers of the packet split receive mode. The header buffers
+ * are slices of a single pre-mapped block which are copied on reception
+ * while the payload pages are handed up and replaced.
+ */
+bool IntelMausi::setupRxPacketSplit()
+{
+    IODMACommand::Segment64 seg;
+    IOPhysicalSegment rxSegment;
+    mbuf_t m;
+    UInt64 offset = 0;
+    UInt32 numSegs = 1;
+    UInt32 i, j;
+    bool result = false;
+
+    rxPSDescArray = (union e1000_rx_desc_packet_split *)rxDescArray;
+    rxPSNumPages = kRxPSNumPages(rxBufferSize);
+
+    rxPSBufArray = (struct intelRxPSBufferInfo *)IOMalloc(numRxDesc * sizeof(struct intelRxPSBufferInfo));
+
+    if (!rxPSBufArray) {
+        IOLog("[IntelMausi]: Couldn't alloc rxPSBufArray.\n");
+        goto done;
+    }
+    bzero(rxPSBufArray, numRxDesc * sizeof(struct intelRxPSBufferInfo));
+
+    rxPSHdrBufDesc = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, (kIODirectionInOut | kIOMemoryPhysicallyContiguous), kRxPSHdrSize(numRxDesc), 0xFFFFFFFFFFFFF000ULL);
+
+    if (!rxPSHdrBufDesc) {
+        IOLog("[IntelMausi]: Couldn't alloc rxPSHdrBufDesc.\n");
+        goto error0;
+    }
+    if (rxPSHdrBufDesc->prepare() != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: rxPSHdrBufDesc->prepare() failed.\n");
+        goto error1;
+    }
+    rxPSHdrArray = (UInt8 *)rxPSHdrBufDesc->getBytesNoCopy();
+
+    rxPSHdrDmaCmd = IODMACommand::withSpecification(kIODMACommandOutputHost64, 64, 0, IODMACommand::kMapped, 0, 1);
+
+    if (!rxPSHdrDmaCmd) {
+        IOLog("[IntelMausi]: Couldn't alloc rxPSHdrDmaCmd.\n");
+        goto error2;
+    }
+    if (rxPSHdrDmaCmd->setMemoryDescriptor(rxPSHdrBufDesc) != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: setMemoryDescriptor() failed.\n");
+        goto error3;
+    }
+    if (rxPSHdrDmaCmd->gen64IOVMSegments(&offset, &seg, &numSegs) != kIOReturnSuccess) {
+        IOLog("[IntelMausi]: gen64IOVMSegments() failed.\n");
+        goto error4;
+    }
+    rxPSHdrPhyAddr = seg.fIOVMAddr;
+
+    /* Alloc the payload pages. */
+    for (i = 0; i < numRxDesc; i++) {
+        for (j = 0; j < rxPSNumPages; j++) {
+            m = allocatePacket(PAGE_SIZE);
+
+            if (!m) {
+                IOLog("[IntelMausi]: Couldn't alloc receive page.\n");
+                goto error5;
+            }
+            rxPSBufArray[i].page[j] = m;
+
+            if ((rxMbufCursor->getPhysicalSegments(m, &rxSegment, 1) != 1) || (rxSegment.location & PAGE_MASK)) {
+                IOLog("[IntelMausi]: getPhysicalSegments() for receive page failed.\n");
+                goto error5;
+            }
+            rxPSBufArray[i].phyAddr[j] = rxSegment.location;
+        }
+        intelRxPSInitDesc(i);
+    }
+    IOLog("[IntelMausi]: Packet split receive with %u pages per descriptor.\n", rxPSNumPages);
+    result = true;
+
+done:
+    return result;
+
+error5:
+    for (i = 0; i < numRxDesc; i++) {
+        for (j = 0; j < PS_PAGE_BUFFERS; j++) {
+            if (rxPSBufArray[i].page[j]) {
+                freePacket(rxPSBufArray[i].page[j]);
+                rxPSBufArray[i].page[j] = NULL;
+            }
+        }
+    }
+
+error4:
+    rxPSHdrDmaCmd->clearMemoryDescriptor();
+
+error3:
+    RELEASE(rxPSHdrDmaCmd);
+
+error2:
+    rxPSHdrBufDesc->complete();
+
+error1:
+    rxPSHdrBufDesc->release();
+    rxPSHdrArray = NULL;
+    rxPSHdrBufDesc = NULL;
+
+error0:
+    IOFree(rxPSBufArray, numRxDesc * sizeof(struct intelRxPSBufferInfo));
+    rxPSBufArray = NULL;
+    goto done;
+}
+
+void IntelMausi::freeRxPacketSplit()
+{
+    UInt32 i, j;
+
+    if (rxPSHdrBufDesc) {
+        rxPSHdrBufDesc->complete();
+        rxPSHdrBufDesc->release();
+        rxPSHdrArray = NULL;
+        rxPSHdrBufDesc = NULL;
+        rxPSHdrPhyAddr = 0;
+    }
+    if (rxPSHdrDmaCmd) {
+        rxPSHdrDmaCmd->clearMemoryDescriptor();
+        rxPSHdrDmaCmd->release();
+        rxPSHdrDmaCmd = NULL;
+    }
+    if (rxPSBufArray) {
+        for (i = 0; i < numRxDesc; i++) {
+            for (j = 0; j < PS_PAGE_BUFFERS; j++) {
+                if (rxPSBufArray[i].page[j]) {
+                    freePacket(rxPSBufArray[i].page[j]);
+                    rxPSBufArray[i].page[j] = NULL;
+                }
+            }
+        }
+        IOFree(rxPSBufArray, numRxDesc * sizeof(struct intelRxPSBufferInfo));
+        rxPSBufArray = NULL;
+    }
+    rxPSNumPages = 0;
+}
+
+/*
+ * Allocate a receive buffer of the pool's buffer size and get its physical
+ * address.
+ */
+bool IntelMausi::intelRxAllocBuffer(mbuf_t *m, IOPhysicalAddress64 *addr)
+{
+    IOPhysicalSegment rxSegment;
+    mbuf_t buf;
+    bool result = false;
+
+    buf = allocatePacket(rxPoolBufSize);
+
+    if (!buf)
+        goto done;
+
+    if ((rxMbufCursor->getPhysicalSegments(buf, &rxSegment, 1) != 1) || (rxSegment.location & kRxBufferAlignMask(rxPoolBufSize)) || (mbuf_maxlen(buf) < rxPoolBufSize)) {
+        DebugLog("[IntelMausi]: getPhysicalSegments() failed.\n");
+        freePacket(buf);
+        goto done;
+    }
+    *m = buf;
+    *addr = rxSegment.location;
+    result = true;
+
+done:
+    return result;
+}
+
+/*
+ * Return an unused buffer to the pool. It's put in front so that it
+ * is taken next while it's still in the cache.
+ */
+void IntelMausi::intelRxPoolPut(mbuf_t m, IOPhysicalAddress64 addr)
+{
+    if (rxPoolCount < kRxPoolSize) {
+        --rxPoolHead &= kRxPoolMask;
+        rxPoolArray[rxPoolHead].mbuf = m;
+        rxPoolArray[rxPoolHead].phyAddr = addr;
+        rxPoolCount++;
+    } else {
+        freePacket(m);
+    }
+}
+
+/* Add up to count new buffers to the rx pool. */
+void IntelMausi::intelRxPoolRefill(UInt32 count)
+{
+    UInt32 index;
+
+    while (count-- && (rxPoolCount < kRxPoolSize)) {
+        index = (rxPoolHead + rxPoolCount) & kRxPoolMask;
+
+        if (!intelRxAllocBuffer(&rxPoolArray[index].mbuf, &rxPoolArray[index].phyAddr))
+            break;
+
+        rxPoolCount++;
+        drvStats.rxPoolRefills++;
+    }
+}
+
+void IntelMausi::intelRxPoolFree()
+{
+    UInt32 i;
+
+    for (i = 0; i < kRxPoolSize; i++) {
+        if (rxPoolArray[i].mbuf) {
+            freePacket(rxPoolArray[i].mbuf);
+            rxPoolArray[i].mbuf = NULL;
+        }
+    }
+    rxPoolHead = rxPoolCount = 0;
+}
+
+/*
+ * Put a discarded receive buffer back into the pool. Returns false in case
+ * it can't be reused so that the caller has to free it.
+ */
+bool IntelMausi::intelRxRecycleBuffer(mbuf_t m)
+{
+    IOPhysicalSegment rxSegment;
+
+    if ((rxPoolCount >= kRxPoolSize) || !rxMbufCursor || (mbuf_maxlen(m) < rxPoolBufSize))
+        return false;
+
+    /* Buffers in the middle of a fragment have lost their packet header. */
+    if (!(mbuf_flags(m) & MBUF_PKTHDR) && mbuf_setflags_mask(m, MBUF_PKTHDR, MBUF_PKTHDR))
+        return false;
+
+    mbuf_setdata(m, mbuf_datastart(m), rxPoolBufSize);
+    mbuf_pkthdr_setlen(m, rxPoolBufSize);
+
+    if ((rxMbufCursor->getPhysicalSegments(m, &rxSegment, 1) != 1) || (rxSegment.location & kRxBufferAlignMask(rxPoolBufSize)))
+        return false;
+
+    intelRxPoolPut(m, rxSegment.location);
+    drvStats.rxPoolRecycled++;
+
+    return true;
+}
+
+/*
+ * Write the buffer addresses of a packet split descriptor as they are
+ * overwritten on descriptor write back.
+ */
+void IntelMausi::intelRxPSInitDesc(UInt32 index)
+{
+    union e1000_rx_desc_packet_split *desc = &rxPSDescArray[index];
+    UInt32 j;
+
+    desc->read.buffer_addr[0] = OSSwapHostToLittleInt64(rxPSHdrPhyAddr + index * kRxPSHdrBufSize);
+
+    for (j = 0; j < PS_PAGE_BUFFERS; j++) {
+        /* Unused buffers get a null pointer for the hardware. */
+        if (j < rxPSNumPages)
+            desc->read.buffer_addr[j + 1] = OSSwapHostToLittleInt64(rxPSBufArray[index].phyAddr[j]);
+        else
+            desc->read.buffer_addr[j + 1] = ~0ULL;
+    }
+}
+
+/*
+ * Change the ring sizes or the size of the receive buffers. The interface
+ * is brought down while the rings are reallocated. In case the new rings
+ * can't be set up, the previous sizes are restored.
+ */
+IOReturn IntelMausi::intelResizeRings(UInt32 txSize, UInt32 rxSize, UInt32 bufSize)
+{
+    IOReturn result = kIOReturnSuccess;
+    UInt32 oldTxSize = numTxDesc;
+    UInt32 oldRxSize = numRxDesc;
+    UInt32 oldBufSize = rxBufferSize;
+    bool wasEnabled = isEnabled;
+
+    if ((txSize == numTxDesc) && (rxSize == numRxDesc) && (bufSize == rxBufferSize))
+        goto done;
+
+    IOLog("[IntelMausi]: Resizing rings to %u tx and %u rx descriptors with %u byte buffers.\n", txSize, rxSize, bufSize);
+
+    if (wasEnabled)
+        driverDisable();
+
+    freeDMADescriptors();
+    numTxDesc = txSize;
+    numRxDesc = rxSize;
+    rxBufferSize = bufSize;
+
+    if (!setupDMADescriptors()) {
+        IOLog("[IntelMausi]: Failed to resize rings. Restoring previous sizes.\n");
+        result = kIOReturnNoMemory;
+
+        numTxDesc = oldTxSize;
+        numRxDesc = oldRxSize;
+        rxBufferSize = oldBufSize;
+
+        if (!setupDMADescriptors()) {
+            IOLog("[IntelMausi]: Error allocating DMA descriptors. Interface stays down.\n");
+
+            /* Without rings the interface can't be brought up again. */
+            linkUp = false;
+            setLinkStatus(kIONetworkLinkValid);
+            goto done;
         }
     }
+    if (wasEnabled)
+        driverEnable();
+
+done:
+    return result;
+}
+
+IOReturn IntelMausi::resizeRingsAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4)
+{
+    IntelMausi *ethCtlr = OSDynamicCast(IntelMausi, owner);
+    IOReturn result = kIOReturnError;
+
+    if (ethCtlr)
+        result = ethCtlr->intelResizeRings((UInt32)(uintptr_t)arg1, (UInt32)(uintptr_t)arg2, ethCtlr->rxBufferSize);
+
+    return result;
+}
+
+/*
+ * Convert an array of VLAN IDs into the bitmap of the VLAN filter table.
+ * VLAN 0 is added to non-empty lists so that priority tagged frames pass.
+ */
+bool IntelMausi::intelParseVlanFilter(OSArray *array, UInt32 *table, UInt32 *count)
+{
+    OSNumber *num;
+    UInt32 vid;
+    UInt32 i;
+    bool result = false;
+
+    bzero(table, kVlanFilterWords * sizeof(UInt32));
+    *count = 0;
+
+    for (i = 0; i < array->getCount(); i++) {
+        num = OSDynamicCast(OSNumber, array->getObject(i));
+
+        if (!num || !(vid = num->unsigned32BitValue()) || (vid > kVlanIdMax)) {
+            IOLog("[IntelMausi]: Invalid VLAN ID in %s. Use IDs from 1 to %u.\n", kVlanFilterName, kVlanIdMax);
+            goto done;
+        }
+        if (!(table[vid >> 5] & (1 << (vid & 0x1f)))) {
+            table[vid >> 5] |= (1 << (vid & 0x1f));
+            (*count)++;
+        }
+    }
+    if (*count)
+        table[0] |= 1;
+
+    result = true;
+
+done:
+    return result;
+}
+
+IOReturn IntelMausi::setVlanFilterAction(OSObject *owner, void *arg1, void *arg2, void *arg3, void *arg4)
+{
+    IntelMausi *ethCtlr = OSDynamicCast(IntelMausi, owner);
+    UInt32 table[kVlanFilterWords];
+    UInt32 count;
+    IOReturn result = kIOReturnError;
+
+    if (!ethCtlr)
+        goto done;
+
+    if (!ethCtlr->intelParseVlanFilter((OSArray *)arg1, table, &count)) {
+        result = kIOReturnBadArgument;
+        goto done;
+    }
+    bcopy(table, ethCtlr->vlanFilterTable, sizeof(table));
+    ethCtlr->vlanFilterCount = count;
+
+    if (ethCtlr->isEnabled)
+        ethCtlr->intelVlanFilterSetup(&ethCtlr->adapterData);
+
+    IOLog("[IntelMausi]: VLAN filter %s with %u IDs.\n", count ? "enabled" : "disabled", count);
+    result = kIOReturnSuccess;
+
+done:
+    return result;
 }
 
 void IntelMausi::clearDescriptors()
@@ -569,25 +1350,67 @@ void IntelMausi::clearDescriptors()
 
     DebugLog("[IntelMausi]: clearDescriptors() ===>\n");
 
+    if (!txBufArray || !rxBufArray)
+        goto done;
+
     /* First cleanup the tx descriptor ring. */
-    for (i = 0; i < kNumTxDesc; i++) {
+    for (i = 0; i < numTxDesc; i++) {
         m = txBufArray[i].mbuf;
 
         if (m) {
             freePacket(m);
             txBufArray[i].mbuf = NULL;
-            txBufArray[i].numDescs = 0;
         }
+        txBufArray[i].numDescs = 0;
+        txBufArray[i].bytes = 0;
+        txBufArray[i].coalesced = false;
     }
     txNextDescIndex = txDirtyIndex = txCleanBarrierIndex = 0;
-    txNumFreeDesc = kNumTxDesc;
+    txNumFreeDesc = numTxDesc;
+    txGSOPacket = NULL;
+    txGSONextSeg = 0;
+    txCoalesceNext = 0;
+    txCoalesceFree = kTxNumCoalesceBufs;
+    intelResetTxBQL();
+
+    /* The hardware's offload context is lost too. */
+    bzero(&txContext, sizeof(txContext));
+
+    /* Cleanup the priority ring. */
+    for (i = 0; i < kNumTxPrioDesc; i++) {
+        m = txPrioBufArray[i].mbuf;
+
+        if (m) {
+            freePacket(m);
+            txPrioBufArray[i].mbuf = NULL;
+        }
+        txPrioBufArray[i].numDescs = 0;
+        txPrioBufArray[i].bytes = 0;
+    }
+    txPrioNextDescIndex = txPrioDirtyIndex = txPrioCleanBarrierIndex = 0;
+    txPrioNumFreeDesc = kNumTxPrioDesc;
+    bzero(&txPrioContext, sizeof(txPrioContext));
+
+#ifdef __PRIVATE_SPI__
+    while (txPendingPacket) {
+        m = txPendingPacket;
+        txPendingPacket = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, NULL);
+        freePacket(m);
+    }
+#else
+    txPendingPackets = 0;
+#endif /* __PRIVATE_SPI__ */
 
     /* On descriptor writeback the buffer addresses are overwritten so that
      * we must restore them in order to make sure that we leave the ring in
      * a usable state.
      */
-    if (rxDescArray) {
-        for (i = 0; i < kNumRxDesc; i++) {
+    if (rxPSDescArray) {
+        for (i = 0; i < numRxDesc; i++)
+            intelRxPSInitDesc(i);
+    } else if (rxDescArray) {
+        for (i = 0; i < numRxDesc; i++) {
             rxDescArray[i].read.buffer_addr = OSSwapHostToLittleInt64(rxBufArray[i].phyAddr);
             rxDescArray[i].read.reserved = 0;
         }
@@ -597,20 +1420,38 @@ void IntelMausi::clearDescriptors()
     /* Free packet fragments which haven't been upstreamed yet.  */
     discardPacketFragment();
 
+done:
     DebugLog("[IntelMausi]: clearDescriptors() <===\n");
 }
 
+void IntelMausi::intelResetTxBQL()
+{
+    txInflightBytes = 0;
+    txBQLLimit = (enableTxBQL) ? kTxBQLMinLimit : kTxBQLNoLimit;
+    txBQLMinSlack = kTxBQLNoLimit;
+    txBQLLimited = false;
+    txBQLStarved = false;
+}
+
 void IntelMausi::discardPacketFragment(bool extended)
 {
+    mbuf_t m, next;
+
     /*
      * In case there is a packet fragment which hasn't been enqueued yet
-     * we have to free it in order to prevent a memory leak.
+     * we have to free it in order to prevent a memory leak. Its buffers
+     * go back into the rx pool where possible.
      */
-    if (rxPacketHead) {
-        if (extended)
-            freePacketEx(rxPacketHead);
-        else
-            freePacket(rxPacketHead);
+    for (m = rxPacketHead; m; m = next) {
+        next = mbuf_next(m);
+        mbuf_setnext(m, NULL);
+
+        if (!intelRxRecycleBuffer(m)) {
+            if (extended)
+                freePacketEx(m);
+            else
+                freePacket(m);
+        }
     }
 
     rxPacketHead = rxPacketTail = NULL;
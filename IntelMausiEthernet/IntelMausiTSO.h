@@ -0,0 +1,213 @@
+/* IntelMausiTSO.h -- TCP segmentation header helpers.
+ *
+ * Copyright (c) 2014 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * The routines in this file work on a flat copy of a packet's headers and
+ * don't touch the driver's state. They are shared with the user space
+ * tests in Tests/ which provide the IOKit types, ETH_HLEN, kMaxSegs and
+ * kMinL4HdrOffsetV4/V6.
+ */
+
+#ifndef _INTELMAUSITSO_H
+#define _INTELMAUSITSO_H
+
+/*
+ * Limits used to detect TSO packets with a geometry known to hang
+ * the transmitter of I217/I218/I219 controllers.
+ */
+#define kTSOMaxSegs     (kMaxSegs - 8)
+#define kTSOMinTailLen  8
+#define kTSOMaxHdrLen   192
+
+/*
+ * Get the offset of the TCP header and the total header length of a
+ * packet whose first copyLen bytes are in hdr. Returns false for packets
+ * which aren't suitable for segmentation offload.
+ */
+static inline bool intelTSOParseHeaders(const UInt8 *hdr, UInt32 copyLen, bool ipv4, UInt32 *l4Offset, UInt32 *hdrLen)
+{
+    const struct ip *ip4;
+    const struct ip6_hdr *ip6;
+    const struct tcphdr *tcp;
+    bool result = false;
+
+    if (ipv4) {
+        if (copyLen < kMinL4HdrOffsetV4)
+            goto done;
+
+        ip4 = (const struct ip *)&hdr[ETH_HLEN];
+        *l4Offset = ETH_HLEN + (ip4->ip_hl << 2);
+
+        if ((*l4Offset < kMinL4HdrOffsetV4) || (ip4->ip_p != IPPROTO_TCP))
+            goto done;
+    } else {
+        if (copyLen < kMinL4HdrOffsetV6)
+            goto done;
+
+        ip6 = (const struct ip6_hdr *)&hdr[ETH_HLEN];
+        *l4Offset = kMinL4HdrOffsetV6;
+
+        if (ip6->ip6_nxt != IPPROTO_TCP)
+            goto done;
+    }
+    if ((*l4Offset + sizeof(struct tcphdr)) > copyLen)
+        goto done;
+
+    tcp = (const struct tcphdr *)&hdr[*l4Offset];
+    *hdrLen = *l4Offset + (tcp->th_off << 2);
+
+    result = (*hdrLen <= copyLen);
+
+done:
+    return result;
+}
+
+/*
+ * Check a TSO packet for buffer layouts which are known to hang the
+ * transmitter: the header must not be split or reach into the last
+ * buffer, the last buffer must not be tiny and there must be enough
+ * headroom left below kMaxSegs.
+ */
+static inline bool intelTSOCheckGeometry(const IOPhysicalSegment *segs, UInt32 numSegs, UInt32 hdrLen)
+{
+    bool result = false;
+
+    if (numSegs > kTSOMaxSegs)
+        goto done;
+
+    if (segs[0].length < hdrLen)
+        goto done;
+
+    if ((numSegs > 1) && (segs[numSegs - 1].length <= kTSOMinTailLen))
+        goto done;
+
+    result = true;
+
+done:
+    return result;
+}
+
+/*
+ * Get the unfolded one's complement sum of the TCP pseudo header
+ * without the length field.
+ */
+static inline UInt32 intelTSOPseudoCsum(const UInt8 *hdr, bool ipv4)
+{
+    const struct ip *ip4;
+    const struct ip6_hdr *ip6;
+    UInt32 csum;
+    UInt32 i;
+
+    if (ipv4) {
+        ip4 = (const struct ip *)&hdr[ETH_HLEN];
+        csum = (ip4->ip_src.s_addr >> 16) + (ip4->ip_src.s_addr & 0xffff) +
+               (ip4->ip_dst.s_addr >> 16) + (ip4->ip_dst.s_addr & 0xffff);
+    } else {
+        ip6 = (const struct ip6_hdr *)&hdr[ETH_HLEN];
+        csum = 0;
+
+        for (i = 0; i < 4; i++) {
+            csum += (ip6->ip6_src.s6_addr32[i] >> 16) + (ip6->ip6_src.s6_addr32[i] & 0xffff);
+            csum += (ip6->ip6_dst.s6_addr32[i] >> 16) + (ip6->ip6_dst.s6_addr32[i] & 0xffff);
+        }
+    }
+    return csum + htons(IPPROTO_TCP);
+}
+
+static inline UInt16 intelTSOFoldCsum(UInt32 csum)
+{
+    csum = (csum >> 16) + (csum & 0xffff);
+    csum += (csum >> 16);
+
+    return (UInt16)csum;
+}
+
+/*
+ * Fix up the headers for hardware segmentation. The hardware computes
+ * the length fields and the checksums of each segment. The TCP checksum
+ * must be seeded with the pseudo header checksum without the length.
+ */
+static inline void intelTSOSetupHeaders(UInt8 *hdr, UInt32 l4Offset, bool ipv4)
+{
+    struct ip *ip4;
+    struct ip6_hdr *ip6;
+    struct tcphdr *tcp = (struct tcphdr *)&hdr[l4Offset];
+
+    if (ipv4) {
+        ip4 = (struct ip *)&hdr[ETH_HLEN];
+        ip4->ip_len = 0;
+        ip4->ip_sum = 0;
+    } else {
+        ip6 = (struct ip6_hdr *)&hdr[ETH_HLEN];
+        ip6->ip6_plen = 0;
+    }
+    tcp->th_sum = intelTSOFoldCsum(intelTSOPseudoCsum(hdr, ipv4));
+}
+
+/*
+ * Prepare the headers of a packet which is segmented in software and get
+ * the pseudo header checksum without the length. The hardware computes
+ * the IP checksum of each segment.
+ */
+static inline UInt32 intelGSOSetupHeaders(UInt8 *hdr, bool ipv4)
+{
+    struct ip *ip4;
+
+    if (ipv4) {
+        ip4 = (struct ip *)&hdr[ETH_HLEN];
+        ip4->ip_sum = 0;
+    }
+    return intelTSOPseudoCsum(hdr, ipv4);
+}
+
+/*
+ * Build the headers of segment seg in slot from the headers prepared by
+ * intelGSOSetupHeaders(). The segment starts at payloadOffset and carries
+ * segLen bytes of payload. FIN and PSH belong to the last segment, CWR to
+ * the first one. The TCP checksum is seeded with the pseudo header
+ * checksum for checksum offload.
+ */
+static inline void intelGSOBuildHeaders(UInt8 *slot, const UInt8 *hdr, UInt32 hdrLen, UInt32 l4Offset, bool ipv4, UInt32 csumBase,
+                                        UInt32 seg, UInt32 lastSeg, UInt32 payloadOffset, UInt32 segLen)
+{
+    struct ip *ip4;
+    struct ip6_hdr *ip6;
+    struct tcphdr *tcp;
+    UInt32 tcpLen = hdrLen - l4Offset + segLen;
+
+    bcopy(hdr, slot, hdrLen);
+
+    if (ipv4) {
+        ip4 = (struct ip *)&slot[ETH_HLEN];
+        ip4->ip_len = htons((UInt16)(hdrLen - ETH_HLEN + segLen));
+        ip4->ip_id = htons((UInt16)(ntohs(ip4->ip_id) + seg));
+    } else {
+        ip6 = (struct ip6_hdr *)&slot[ETH_HLEN];
+        ip6->ip6_plen = htons((UInt16)tcpLen);
+    }
+    tcp = (struct tcphdr *)&slot[l4Offset];
+    tcp->th_seq = htonl(ntohl(tcp->th_seq) + payloadOffset);
+
+    if (seg != lastSeg)
+        tcp->th_flags &= ~(TH_FIN | TH_PUSH);
+
+    if (seg)
+        tcp->th_flags &= ~TH_CWR;
+
+    tcp->th_sum = intelTSOFoldCsum(csumBase + htons((UInt16)tcpLen));
+}
+
+#endif /* _INTELMAUSITSO_H */
@@ -0,0 +1,243 @@
+/* IntelMausiTx.h -- IntelMausi tx descriptor builder.
+ *
+ * Copyright (c) 2014 Laura Müller <laura-mueller@uni-duesseldorf.de>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Driver for Intel PCIe gigabit ethernet controllers.
+ *
+ * The offload table, the descriptor builder and the ring scan of the hang
+ * check don't touch the driver's state apart from the ring passed in.
+ * They are shared with the user space tests in Tests/ which provide the
+ * IOKit types, the descriptor layouts of hw.h and the checksum offload
+ * constants.
+ */
+
+#ifndef _INTELMAUSITX_H
+#define _INTELMAUSITX_H
+
+struct intelTxBufferInfo {
+    mbuf_t mbuf;
+    UInt32 numDescs;
+    UInt32 pad;
+    UInt32 bytes;
+    bool coalesced;
+    UInt64 time;
+};
+
+/* The offload context which has been programmed last. */
+struct intelTxContext {
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    UInt32 cmdLen;
+    UInt32 segSetup;
+};
+
+/* Parameters of the context and the data descriptors of a packet. */
+struct intelTxOffload {
+    UInt32 ipConfig;
+    UInt32 tcpConfig;
+    UInt32 cmdLen;
+    UInt32 segSetup;
+    UInt32 cmd;
+    UInt32 word2;
+};
+
+enum {
+    kTxOffloadNone = 0,
+    kTxOffloadIP,
+    kTxOffloadTCP,
+    kTxOffloadUDP,
+    kTxOffloadTCPIPv6,
+    kTxOffloadUDPIPv6,
+    kTxOffloadTypeCount
+};
+
+/* Checksum offload parameters indexed by offload type. */
+static const struct intelTxOffload txOffloadTable[kTxOffloadTypeCount] = {
+    /* kTxOffloadNone */
+    { .ipConfig = 0, .tcpConfig = 0, .cmdLen = 0, .segSetup = 0, .cmd = 0, .word2 = 0 },
+
+    /* kTxOffloadIP */
+    { .ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart),
+      .tcpConfig = 0,
+      .cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP),
+      .segSetup = 0,
+      .cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+      .word2 = E1000_TXD_OPTS_IXSM },
+
+    /* kTxOffloadTCP */
+    { .ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart),
+      .tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart),
+      .cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP),
+      .segSetup = 0,
+      .cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+      .word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM) },
+
+    /* kTxOffloadUDP */
+    { .ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart),
+      .tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart),
+      .cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP),
+      .segSetup = 0,
+      .cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+      .word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM) },
+
+    /* kTxOffloadTCPIPv6 */
+    { .ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart),
+      .tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart),
+      .cmdLen = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP),
+      .segSetup = 0,
+      .cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+      .word2 = E1000_TXD_OPTS_TXSM },
+
+    /* kTxOffloadUDPIPv6 */
+    { .ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart),
+      .tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart),
+      .cmdLen = E1000_TXD_CMD_DEXT,
+      .segSetup = 0,
+      .cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D),
+      .word2 = E1000_TXD_OPTS_TXSM },
+};
+
+/*
+ * Offload type for each combination of kChecksumIP, kChecksumTCP and
+ * kChecksumUDP. TCP takes precedence over UDP and UDP over IP.
+ */
+static const UInt8 txOffloadTypeIPv4[8] = {
+    kTxOffloadNone,     /* none */
+    kTxOffloadIP,       /* IP */
+    kTxOffloadTCP,      /* TCP */
+    kTxOffloadTCP,      /* TCP + IP */
+    kTxOffloadUDP,      /* UDP */
+    kTxOffloadUDP,      /* UDP + IP */
+    kTxOffloadTCP,      /* UDP + TCP */
+    kTxOffloadTCP,      /* UDP + TCP + IP */
+};
+
+static inline const struct intelTxOffload *getTxOffload(UInt32 offloadFlags)
+{
+    UInt32 type = txOffloadTypeIPv4[offloadFlags & (kChecksumIP | kChecksumTCP | kChecksumUDP)];
+
+    if ((type == kTxOffloadNone) && (offloadFlags & (kChecksumTCPIPv6 | kChecksumUDPIPv6)))
+        type = (offloadFlags & kChecksumTCPIPv6) ? kTxOffloadTCPIPv6 : kTxOffloadUDPIPv6;
+
+    return &txOffloadTable[type];
+}
+
+/*
+ * The hardware keeps the last offload context so that a context descriptor
+ * is only needed when the offload parameters change.
+ */
+static inline bool intelTxNeedsContext(const struct intelTxContext *context, UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLen, UInt32 segSetup)
+{
+    return ((context->cmdLen != cmdLen) || (context->ipConfig != ipConfig) ||
+            (context->tcpConfig != tcpConfig) || (context->segSetup != segSetup));
+}
+
+static inline void intelTxWriteContext(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, struct intelTxContext *context,
+                                       UInt32 index, UInt32 ipConfig, UInt32 tcpConfig, UInt32 cmdLen, UInt32 segSetup)
+{
+    struct e1000_context_desc *contDesc = (struct e1000_context_desc *)&descArray[index];
+
+    bufArray[index].mbuf = NULL;
+    bufArray[index].numDescs = 0;
+
+#ifdef DEBUG
+    bufArray[index].pad = 0;
+#endif
+
+    contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
+    contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
+    contDesc->cmd_and_length = OSSwapHostToLittleInt32(cmdLen);
+    contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(segSetup);
+
+    context->ipConfig = ipConfig;
+    context->tcpConfig = tcpConfig;
+    context->cmdLen = cmdLen;
+    context->segSetup = segSetup;
+}
+
+/*
+ * Write the descriptors of a packet starting at index: a context descriptor
+ * in case the ring's context doesn't match the offload parameters and a
+ * data descriptor for each segment. opts holds the command bits of the
+ * last descriptor and word2 the packet's options including the VLAN tag.
+ * The last descriptor gets the mbuf and the number of descriptors used,
+ * which is returned.
+ */
+static inline UInt32 intelTxWriteDescs(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, UInt32 index, UInt32 mask,
+                                       struct intelTxContext *context, const IOPhysicalSegment *segs, UInt32 numSegs,
+                                       const struct intelTxOffload *offload, UInt32 opts, UInt32 word2, mbuf_t m)
+{
+    struct e1000_data_desc *desc;
+    UInt32 cmd = offload->cmd;
+    UInt32 numDescs = numSegs;
+    UInt32 lastSeg = numSegs - 1;
+    UInt32 i;
+
+    /* Setup the context descriptor unless the hardware has it already. */
+    if (offload->cmdLen && intelTxNeedsContext(context, offload->ipConfig, offload->tcpConfig, offload->cmdLen, offload->segSetup)) {
+        intelTxWriteContext(descArray, bufArray, context, index, offload->ipConfig, offload->tcpConfig, offload->cmdLen, offload->segSetup);
+        ++index &= mask;
+        numDescs++;
+    }
+    /* Fill in the data descriptors. Only the last one ends the packet. */
+    for (i = 0; i < lastSeg; i++) {
+        desc = &descArray[index];
+        desc->buffer_addr = OSSwapHostToLittleInt64(segs[i].location);
+        desc->lower.data = OSSwapHostToLittleInt32(cmd | (segs[i].length & 0x000fffff));
+        desc->upper.data = OSSwapHostToLittleInt32(word2);
+
+        bufArray[index].mbuf = NULL;
+        bufArray[index].numDescs = 0;
+
+#ifdef DEBUG
+        bufArray[index].pad = (UInt32)segs[i].length;
+#endif
+
+        ++index &= mask;
+    }
+    desc = &descArray[index];
+    desc->buffer_addr = OSSwapHostToLittleInt64(segs[lastSeg].location);
+    desc->lower.data = OSSwapHostToLittleInt32(cmd | opts | (segs[lastSeg].length & 0x000fffff));
+    desc->upper.data = OSSwapHostToLittleInt32(word2);
+
+    bufArray[index].mbuf = m;
+    bufArray[index].numDescs = numDescs;
+
+#ifdef DEBUG
+    bufArray[index].pad = (UInt32)segs[lastSeg].length;
+#endif
+
+    return numDescs;
+}
+
+/*
+ * Find the last descriptor of the oldest packet between start and end
+ * which the hardware hasn't completed yet. Packets which have been sent
+ * but not released so far are skipped. Returns end in case all packets
+ * have been sent.
+ */
+static inline UInt32 intelTxFindPending(const struct e1000_data_desc *descArray, const struct intelTxBufferInfo *bufArray,
+                                        UInt32 start, UInt32 end, UInt32 mask)
+{
+    UInt32 index;
+
+    for (index = start; index != end; ++index &= mask) {
+        /* Only the last descriptor of a packet has numDescs set. */
+        if (bufArray[index].numDescs && !(OSSwapLittleToHostInt32(descArray[index].upper.data) & E1000_TXD_STAT_DD))
+            break;
+    }
+    return index;
+}
+
+#endif /* _INTELMAUSITX_H */
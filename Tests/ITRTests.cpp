@@ -0,0 +1,318 @@
+/* ITRTests.cpp -- Tests of the adaptive interrupt throttling.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * intelItrClass() and intelItrNextRate() are compared with a port of
+ * e1000_update_itr() and the dynamic mode of e1000_set_itr() of Linux's
+ * e1000e driver: for all classes on a grid of packet and byte counts
+ * including the boundaries of the classification, and for random
+ * sequences of rx and tx intervals. Traces of typical traffic must end
+ * up at the expected rates.
+ */
+
+#include "TestSupport.h"
+#include "IntelMausiITR.h"
+
+/* Port of ../IntelMausiEthernet/netdev.c at 1000 Mbit/s with itr_setting 1 (dynamic) */
+enum latency_range {
+    lowest_latency = 0,
+    low_latency = 1,
+    bulk_latency = 2,
+    latency_invalid = 255
+};
+
+static unsigned int e1000_update_itr(UInt16 itr_setting, int packets, int bytes)
+{
+    unsigned int retval = itr_setting;
+
+    if (packets == 0)
+        return itr_setting;
+
+    switch (itr_setting) {
+    case lowest_latency:
+        /* handle TSO and jumbo frames */
+        if (bytes / packets > 8000)
+            retval = bulk_latency;
+        else if ((packets < 5) && (bytes > 512))
+            retval = low_latency;
+        break;
+    case low_latency:   /* 50 usec aka 20000 ints/s */
+        if (bytes > 10000) {
+            /* this if handles the TSO accounting */
+            if (bytes / packets > 8000)
+                retval = bulk_latency;
+            else if ((packets < 10) || ((bytes / packets) > 1200))
+                retval = bulk_latency;
+            else if ((packets > 35))
+                retval = lowest_latency;
+        } else if (bytes / packets > 2000) {
+            retval = bulk_latency;
+        } else if (packets <= 2 && bytes < 512) {
+            retval = lowest_latency;
+        }
+        break;
+    case bulk_latency:  /* 250 usec aka 4000 ints/s */
+        if (bytes > 25000) {
+            if (packets > 35)
+                retval = low_latency;
+        } else if (bytes < 6000) {
+            retval = low_latency;
+        }
+        break;
+    }
+
+    return retval;
+}
+
+struct e1000_adapter {
+    UInt16 rx_itr;
+    UInt16 tx_itr;
+    UInt32 itr;
+    UInt32 total_rx_packets;
+    UInt32 total_rx_bytes;
+    UInt32 total_tx_packets;
+    UInt32 total_tx_bytes;
+};
+
+static void e1000_set_itr(struct e1000_adapter *adapter)
+{
+    UInt16 current_itr;
+    UInt32 new_itr = adapter->itr;
+
+    adapter->tx_itr = e1000_update_itr(adapter->tx_itr, adapter->total_tx_packets, adapter->total_tx_bytes);
+    adapter->rx_itr = e1000_update_itr(adapter->rx_itr, adapter->total_rx_packets, adapter->total_rx_bytes);
+
+    current_itr = (adapter->rx_itr > adapter->tx_itr) ? adapter->rx_itr : adapter->tx_itr;
+
+    /* counts and packets in update_itr are dependent on these numbers */
+    switch (current_itr) {
+    case lowest_latency:
+        new_itr = 70000;
+        break;
+    case low_latency:
+        new_itr = 20000;    /* aka hwitr = ~200 */
+        break;
+    case bulk_latency:
+        new_itr = 4000;
+        break;
+    default:
+        break;
+    }
+
+    if (new_itr != adapter->itr) {
+        /* this attempts to bias the interrupt rate towards Bulk
+         * by adding intermediate steps when interrupt rate is
+         * increasing
+         */
+        new_itr = new_itr > adapter->itr ? min(adapter->itr + (new_itr >> 2), new_itr) : new_itr;
+        adapter->itr = new_itr;
+    }
+}
+
+/* The driver's state as kept by intelResetITR() and intelUpdateITR(). */
+struct TestItr {
+    UInt32 rxClass;
+    UInt32 txClass;
+    UInt32 rate;
+};
+
+static void itrReset(struct TestItr *itr, struct e1000_adapter *adapter)
+{
+    itr->rxClass = itr->txClass = kItrLowLatency;
+    itr->rate = kItrRateLow;
+
+    memset(adapter, 0, sizeof(*adapter));
+    adapter->rx_itr = adapter->tx_itr = low_latency;
+    adapter->itr = 20000;
+}
+
+static void itrUpdate(struct TestItr *itr, UInt32 rxPackets, UInt32 rxBytes, UInt32 txPackets, UInt32 txBytes)
+{
+    UInt32 itrClass;
+
+    itr->rxClass = intelItrClass(itr->rxClass, rxPackets, rxBytes);
+    itr->txClass = intelItrClass(itr->txClass, txPackets, txBytes);
+    itrClass = (itr->rxClass > itr->txClass) ? itr->rxClass : itr->txClass;
+    itr->rate = intelItrNextRate(itr->rate, itrClass);
+}
+
+/* Packet and byte counts at and around the limits of the classification. */
+static const UInt32 packetCounts[] = {
+    0, 1, 2, 3, 4, 5, 6, 9, 10, 11, 20, 35, 36, 37, 64, 100, 1000, 100000
+};
+
+static const UInt32 byteLimits[] = {
+    0, 511, 512, 513, 5999, 6000, 6001, 9999, 10000, 10001, 24999, 25000, 25001
+};
+
+static const UInt32 perPacketLimits[] = {
+    1200, 2000, 8000
+};
+
+static void checkClass(UInt32 itrClass, UInt32 packets, UInt32 bytes)
+{
+    CHECK(intelItrClass(itrClass, packets, bytes) == e1000_update_itr(itrClass, packets, bytes));
+}
+
+/* All classes with counts at the limits and at random. */
+static void testClassGrid()
+{
+    UInt32 itrClass, p, b, l, n;
+    UInt32 packets, bytes;
+
+    for (itrClass = kItrLowestLatency; itrClass <= kItrBulkLatency; itrClass++) {
+        for (p = 0; p < sizeof(packetCounts) / sizeof(packetCounts[0]); p++) {
+            packets = packetCounts[p];
+
+            for (b = 0; b < sizeof(byteLimits) / sizeof(byteLimits[0]); b++)
+                checkClass(itrClass, packets, byteLimits[b]);
+
+            /* Bytes per packet at the limits. */
+            for (l = 0; l < sizeof(perPacketLimits) / sizeof(perPacketLimits[0]); l++) {
+                bytes = perPacketLimits[l] * packets;
+
+                checkClass(itrClass, packets, bytes);
+                checkClass(itrClass, packets, bytes + packets);
+                checkClass(itrClass, packets, bytes + packets - 1);
+            }
+        }
+        for (packets = 0; packets < 64; packets++) {
+            for (bytes = 0; bytes < 70000; bytes += 7)
+                checkClass(itrClass, packets, bytes);
+        }
+        for (n = 0; n < 1000000; n++) {
+            packets = testRandRange(0, 5000);
+            bytes = testRandRange(0, 0x7fffffff);
+            checkClass(itrClass, packets, bytes);
+            checkClass(itrClass, packets, bytes % 100000);
+        }
+    }
+    /* There's no class of an interval without packets. */
+    for (itrClass = kItrLowestLatency; itrClass <= kItrBulkLatency; itrClass++)
+        CHECK(intelItrClass(itrClass, 0, 12345) == itrClass);
+}
+
+/* A random interval: idle, RPC, mixed or bulk with and without TSO. */
+static void randomInterval(UInt32 *packets, UInt32 *bytes)
+{
+    switch (testRandRange(0, 4)) {
+        case 0:
+            *packets = 0;
+            *bytes = 0;
+            break;
+
+        case 1:
+            *packets = testRandRange(1, 3);
+            *bytes = *packets * testRandRange(60, 300);
+            break;
+
+        case 2:
+            *packets = testRandRange(1, 50);
+            *bytes = *packets * testRandRange(60, 1514);
+            break;
+
+        case 3:
+            *packets = testRandRange(1, 100);
+            *bytes = *packets * 1514;
+            break;
+
+        default:
+            *packets = testRandRange(1, 20);
+            *bytes = *packets * testRandRange(1514, 65535);
+            break;
+    }
+}
+
+/* Sequences of rx and tx intervals must lead to the same rates. */
+static void testRateSequences()
+{
+    struct e1000_adapter adapter;
+    struct TestItr itr;
+    UInt32 n, i;
+
+    for (n = 0; n < 2000; n++) {
+        itrReset(&itr, &adapter);
+
+        for (i = 0; i < 200; i++) {
+            randomInterval(&adapter.total_rx_packets, &adapter.total_rx_bytes);
+            randomInterval(&adapter.total_tx_packets, &adapter.total_tx_bytes);
+
+            itrUpdate(&itr, adapter.total_rx_packets, adapter.total_rx_bytes, adapter.total_tx_packets, adapter.total_tx_bytes);
+            e1000_set_itr(&adapter);
+
+            CHECK(itr.rxClass == adapter.rx_itr);
+            CHECK(itr.txClass == adapter.tx_itr);
+            CHECK(itr.rate == adapter.itr);
+            CHECK((itr.rate >= kItrRateBulk) && (itr.rate <= kItrRateLowest));
+        }
+    }
+}
+
+/* Typical traffic ends up at the rate of its class. */
+static void testTraces()
+{
+    struct e1000_adapter adapter;
+    struct TestItr itr;
+    UInt32 i;
+
+    /* Request/response with small packets: lowest latency. */
+    itrReset(&itr, &adapter);
+
+    for (i = 0; i < 10; i++)
+        itrUpdate(&itr, 1, 100, 1, 100);
+
+    CHECK(itr.rxClass == kItrLowestLatency);
+    CHECK(itr.rate == kItrRateLowest);
+
+    /* Lowest latency stays as long as there are many packets per interval. */
+    itrUpdate(&itr, 44, 44 * 1514, 22, 22 * 66);
+    CHECK(itr.rxClass == kItrLowestLatency);
+
+    /* A bulk transfer takes two intervals to drop to the bulk rate. */
+    itrUpdate(&itr, 4, 4 * 1514, 2, 2 * 66);
+    CHECK(itr.rxClass == kItrLowLatency);
+    CHECK(itr.rate == kItrRateLow);
+
+    itrUpdate(&itr, 20, 20 * 1514, 10, 10 * 66);
+    CHECK(itr.rxClass == kItrBulkLatency);
+    CHECK(itr.rate == kItrRateBulk);
+
+    /* TSO sends count as bulk. */
+    itrReset(&itr, &adapter);
+    itrUpdate(&itr, 0, 0, 2, 2 * 65000);
+    CHECK(itr.txClass == kItrBulkLatency);
+    CHECK(itr.rate == kItrRateBulk);
+
+    /* Back to requests: the rate rises in steps of a quarter. */
+    itrUpdate(&itr, 1, 100, 1, 100);
+    CHECK(itr.rxClass == kItrLowestLatency);
+    CHECK(itr.txClass == kItrLowLatency);
+    CHECK(itr.rate == kItrRateBulk + (kItrRateLow >> 2));
+
+    for (i = 0; i < 20; i++)
+        itrUpdate(&itr, 1, 100, 1, 100);
+
+    CHECK(itr.rate == kItrRateLowest);
+
+    /* The register values of the rates. */
+    CHECK(kItrRegValue(kItrRateLowest) == 55);
+    CHECK(kItrRegValue(kItrRateLow) == 195);
+    CHECK(kItrRegValue(kItrRateBulk) == 976);
+}
+
+int main()
+{
+    testClassGrid();
+    testRateSequences();
+    testTraces();
+
+    return testResult("ITRTests");
+}
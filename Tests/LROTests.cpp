@@ -0,0 +1,1111 @@
+/* LROTests.cpp -- Capture replay tests of the software receive coalescing.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * A pcap capture is replayed through intelLroReceive() and
+ * intelLroFlushAll() the way rxInterrupt() calls them. Packets which arrive
+ * less than kRunGap µs after their predecessor belong to the same rx run,
+ * the flows are flushed at the end of each run. The receive status is
+ * computed from the frames' checksums, the hash with the Toeplitz
+ * reference.
+ *
+ * The output is checked against the input stream:
+ * - packets of each TCP connection come out in the order they went in and
+ *   the payload stream of each connection is unchanged,
+ * - all other packets come out unchanged and in order,
+ * - a packet which hasn't been merged is handed up unchanged,
+ * - a merged packet carries the headers of its first segment with a new IP
+ *   length and a valid IP checksum, the ack, window and timestamps of its
+ *   last segment and the flags of all segments. Only in-order segments
+ *   with valid checksums, ACK and optionally PSH on the last segment, no
+ *   options but timestamps and the same options in all segments may have
+ *   been merged and the merged packet must not exceed kRxLroMaxLen,
+ * - no mbuf is lost.
+ *
+ * The capture is generated with several TCP connections, some on VLANs,
+ * and the events which must stop coalescing: retransmissions, reordering,
+ * pure acks, PSH and FIN, old acks and timestamps, IP options, fragments,
+ * CE marks, bad checksums, other TCP options, UDP and IPv6. A capture file
+ * given on the command line is replayed as well, -w writes the generated
+ * one.
+ */
+
+#include "TestSupport.h"
+#include "MbufSupport.h"
+#include "IntelMausiRSS.h"
+#include "IntelMausiLRO.h"
+
+#define kMaxFrameLen    1518
+#define kMaxRecords     32768
+#define kMaxKeys        256
+#define kNumGenFlows    12
+#define kNumGenPackets  20000
+#define kRunGap         30
+#define kMaxRunLen      512
+#define kPcapBufSize    (kNumGenPackets * (kMaxFrameLen + 16) + 24)
+
+#define kPcapMagic      0xa1b2c3d4
+#define kLinkTypeEther  1
+
+#define kTSOptLen       12
+
+/* A frame of the capture with the VLAN tag removed as the hardware does. */
+struct Record {
+    UInt8 frame[kMaxFrameLen + 4];
+    UInt32 len;
+    UInt16 vlanTag;
+    bool hasVlanTag;
+    UInt32 status;
+    SInt32 key;             /* TCP connection or -1 */
+    SInt32 next;            /* next record of the connection or the other packets */
+};
+
+/* A TCP connection: addresses, ports and VLAN. */
+struct FlowKey {
+    UInt8 addrs[8];
+    UInt8 ports[4];
+    UInt16 vlanTag;
+    bool hasVlanTag;
+};
+
+struct Queue {
+    SInt32 head;
+    SInt32 tail;
+};
+
+static struct Record records[kMaxRecords];
+static UInt32 numRecords;
+static struct FlowKey keys[kMaxKeys];
+static struct Queue keyQueues[kMaxKeys];
+static UInt32 numKeys;
+static struct Queue otherQueue;
+static UInt8 rssKey[40];
+
+/* Statistics of a replay. */
+static UInt32 outMerged;
+static UInt32 outSegsMerged;
+static UInt32 outMaxLen;
+
+/* pcap */
+
+struct PcapWriter {
+    UInt8 *buf;
+    UInt32 len;
+};
+
+static void put32(UInt8 *p, UInt32 v)
+{
+    memcpy(p, &v, 4);
+}
+
+static void put16(UInt8 *p, UInt16 v)
+{
+    memcpy(p, &v, 2);
+}
+
+static UInt32 get32(const UInt8 *p, bool swap)
+{
+    UInt32 v;
+
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static void pcapInit(struct PcapWriter *w, UInt8 *buf)
+{
+    w->buf = buf;
+    put32(&buf[0], kPcapMagic);
+    put16(&buf[4], 2);
+    put16(&buf[6], 4);
+    put32(&buf[8], 0);
+    put32(&buf[12], 0);
+    put32(&buf[16], 65535);
+    put32(&buf[20], kLinkTypeEther);
+    w->len = 24;
+}
+
+static void pcapAdd(struct PcapWriter *w, UInt64 usecs, const UInt8 *frame, UInt32 len)
+{
+    UInt8 *p = &w->buf[w->len];
+
+    put32(&p[0], (UInt32)(usecs / 1000000));
+    put32(&p[4], (UInt32)(usecs % 1000000));
+    put32(&p[8], len);
+    put32(&p[12], len);
+    memcpy(&p[16], frame, len);
+    w->len += 16 + len;
+}
+
+/* generator */
+
+struct GenFlow {
+    UInt8 addrs[8];
+    UInt16 sport;
+    UInt16 dport;
+    UInt16 vlanTag;         /* 0 means untagged */
+    UInt32 optKind;         /* 0 none, 1 timestamps, 2 SACK */
+    UInt32 seq;
+    UInt32 ack;
+    UInt32 tsVal;
+    UInt32 tsEcr;
+    UInt16 win;
+    UInt16 ipId;
+    UInt32 id;
+};
+
+struct GenSeg {
+    UInt32 seq;
+    UInt32 payloadLen;
+    UInt8 flags;
+    UInt32 ack;
+    UInt32 tsVal;
+    UInt32 tsEcr;
+    UInt32 ipOptLen;
+    UInt8 tos;
+    UInt16 ipOff;
+    bool badIPCsum;
+    bool badTCPCsum;
+    bool noOpts;
+};
+
+static struct GenFlow genFlows[kNumGenFlows];
+
+static UInt8 payloadByte(const struct GenFlow *f, UInt32 seq)
+{
+    UInt32 x = seq * 2654435761u + f->id * 40503u;
+
+    return (UInt8)(x >> 24);
+}
+
+/* Prepend the tag in case the frame belongs to a VLAN. */
+static UInt32 addVlanTag(UInt8 *frame, UInt32 len, UInt16 vlanTag)
+{
+    if (!vlanTag)
+        return len;
+
+    memmove(&frame[16], &frame[12], len - 12);
+    testPut16(&frame[12], ETHERTYPE_VLAN);
+    testPut16(&frame[14], vlanTag);
+
+    return len + 4;
+}
+
+static void setMacs(UInt8 *frame)
+{
+    static const UInt8 macs[12] = { 0x00, 0x1b, 0x21, 0x11, 0x22, 0x33, 0x00, 0x1c, 0x42, 0x44, 0x55, 0x66 };
+
+    memcpy(frame, macs, 12);
+}
+
+static UInt32 padFrame(UInt8 *frame, UInt32 len)
+{
+    if (len < 60) {
+        memset(&frame[len], 0, 60 - len);
+        len = 60;
+    }
+    return len;
+}
+
+static UInt32 buildTCPFrame(UInt8 *frame, struct GenFlow *f, const struct GenSeg *s)
+{
+    UInt32 ipHdrLen = 20 + s->ipOptLen;
+    UInt32 optKind = s->noOpts ? 0 : f->optKind;
+    UInt32 tcpHdrLen = 20 + (optKind ? kTSOptLen : 0);
+    UInt32 ipLen = ipHdrLen + tcpHdrLen + s->payloadLen;
+    UInt8 *ip = &frame[ETH_HLEN];
+    UInt8 *tcp = &ip[ipHdrLen];
+    UInt32 sum;
+    UInt32 i;
+
+    memset(frame, 0, ETH_HLEN + ipHdrLen + tcpHdrLen);
+    setMacs(frame);
+    testPut16(&frame[12], ETHERTYPE_IP);
+
+    ip[0] = 0x40 | (ipHdrLen >> 2);
+    ip[1] = s->tos;
+    testPut16(&ip[2], (UInt16)ipLen);
+    testPut16(&ip[4], f->ipId++);
+    testPut16(&ip[6], s->ipOff);
+    ip[8] = 64;
+    ip[9] = IPPROTO_TCP;
+    memcpy(&ip[12], f->addrs, 8);
+
+    for (i = 20; i < ipHdrLen; i++)
+        ip[i] = IPOPT_NOP;
+
+    testPut16(&ip[10], (UInt16)~testCsumFold(testCsumAdd(ip, ipHdrLen, 0)));
+
+    if (s->badIPCsum)
+        ip[10] ^= 0x5a;
+
+    testPut16(&tcp[0], f->sport);
+    testPut16(&tcp[2], f->dport);
+    testPut16(&tcp[4], (UInt16)(s->seq >> 16));
+    testPut16(&tcp[6], (UInt16)s->seq);
+    testPut16(&tcp[8], (UInt16)(s->ack >> 16));
+    testPut16(&tcp[10], (UInt16)s->ack);
+    tcp[12] = (UInt8)((tcpHdrLen >> 2) << 4);
+    tcp[13] = s->flags;
+    testPut16(&tcp[14], f->win);
+
+    if (optKind == 1) {
+        tcp[20] = TCPOPT_NOP;
+        tcp[21] = TCPOPT_NOP;
+        tcp[22] = TCPOPT_TIMESTAMP;
+        tcp[23] = TCPOLEN_TIMESTAMP;
+        testPut16(&tcp[24], (UInt16)(s->tsVal >> 16));
+        testPut16(&tcp[26], (UInt16)s->tsVal);
+        testPut16(&tcp[28], (UInt16)(s->tsEcr >> 16));
+        testPut16(&tcp[30], (UInt16)s->tsEcr);
+    } else if (optKind == 2) {
+        tcp[20] = TCPOPT_NOP;
+        tcp[21] = TCPOPT_NOP;
+        tcp[22] = TCPOPT_SACK;
+        tcp[23] = 10;
+        testPut16(&tcp[24], (UInt16)(s->ack >> 16));
+        testPut16(&tcp[26], (UInt16)s->ack);
+        testPut16(&tcp[28], (UInt16)((s->ack + 1000) >> 16));
+        testPut16(&tcp[30], (UInt16)(s->ack + 1000));
+    }
+    for (i = 0; i < s->payloadLen; i++)
+        tcp[tcpHdrLen + i] = payloadByte(f, s->seq + i);
+
+    /* Pseudo header and segment. */
+    sum = testCsumAdd(&ip[12], 8, 0) + IPPROTO_TCP + tcpHdrLen + s->payloadLen;
+    sum = testCsumAdd(tcp, tcpHdrLen + s->payloadLen, sum);
+    testPut16(&tcp[16], (UInt16)~testCsumFold(sum));
+
+    if (s->badTCPCsum)
+        tcp[16] ^= 0xa5;
+
+    return padFrame(frame, ETH_HLEN + ipLen);
+}
+
+static UInt32 buildUDPFrame(UInt8 *frame, struct GenFlow *f, UInt32 payloadLen)
+{
+    UInt8 *ip = &frame[ETH_HLEN];
+    UInt8 *udp = &ip[20];
+    UInt32 sum;
+    UInt32 i;
+
+    memset(frame, 0, ETH_HLEN + 28);
+    setMacs(frame);
+    testPut16(&frame[12], ETHERTYPE_IP);
+
+    ip[0] = 0x45;
+    testPut16(&ip[2], (UInt16)(28 + payloadLen));
+    testPut16(&ip[4], f->ipId++);
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    memcpy(&ip[12], f->addrs, 8);
+    testPut16(&ip[10], (UInt16)~testCsumFold(testCsumAdd(ip, 20, 0)));
+
+    testPut16(&udp[0], f->sport);
+    testPut16(&udp[2], 53);
+    testPut16(&udp[4], (UInt16)(8 + payloadLen));
+
+    for (i = 0; i < payloadLen; i++)
+        udp[8 + i] = (UInt8)testRand();
+
+    sum = testCsumAdd(&ip[12], 8, 0) + IPPROTO_UDP + 8 + payloadLen;
+    sum = testCsumAdd(udp, 8 + payloadLen, sum);
+    testPut16(&udp[6], (UInt16)~testCsumFold(sum));
+
+    return padFrame(frame, ETH_HLEN + 28 + payloadLen);
+}
+
+/* A TCP/IPv6 segment which must pass through unchanged. */
+static UInt32 buildIPv6Frame(UInt8 *frame, struct GenFlow *f, UInt32 payloadLen)
+{
+    UInt8 *ip6 = &frame[ETH_HLEN];
+    UInt8 *tcp = &ip6[40];
+    UInt32 i;
+
+    memset(frame, 0, ETH_HLEN + 60);
+    setMacs(frame);
+    testPut16(&frame[12], ETHERTYPE_IPV6);
+
+    ip6[0] = 0x60;
+    testPut16(&ip6[4], (UInt16)(20 + payloadLen));
+    ip6[6] = IPPROTO_TCP;
+    ip6[7] = 64;
+    memcpy(&ip6[8], f->addrs, 8);
+    memcpy(&ip6[24], f->addrs, 8);
+
+    testPut16(&tcp[0], f->sport);
+    testPut16(&tcp[2], f->dport);
+    tcp[12] = 0x50;
+    tcp[13] = TH_ACK;
+
+    for (i = 0; i < payloadLen; i++)
+        tcp[20 + i] = (UInt8)testRand();
+
+    return ETH_HLEN + 60 + payloadLen;
+}
+
+static UInt32 buildARPFrame(UInt8 *frame)
+{
+    UInt32 i;
+
+    memset(frame, 0xff, 6);
+    memcpy(&frame[6], &frame[0], 6);
+    testPut16(&frame[12], ETHERTYPE_ARP);
+
+    for (i = 14; i < 42; i++)
+        frame[i] = (UInt8)testRand();
+
+    return padFrame(frame, 42);
+}
+
+static void initGenFlows()
+{
+    struct GenFlow *f;
+    UInt32 i;
+
+    for (i = 0; i < kNumGenFlows; i++) {
+        f = &genFlows[i];
+        memset(f, 0, sizeof(*f));
+        f->id = i;
+        f->addrs[0] = 10;
+        f->addrs[1] = 0;
+        f->addrs[2] = 0;
+        f->addrs[3] = (UInt8)(1 + (i % 3));
+        f->addrs[4] = 192;
+        f->addrs[5] = 168;
+        f->addrs[6] = 1;
+        f->addrs[7] = 2;
+        f->sport = (UInt16)(49152 + (i % 5));
+        f->dport = (i & 1) ? 443 : 22;
+        f->optKind = (i < 8) ? 1 : ((i < 10) ? 0 : 2);
+        f->seq = testRand();
+        f->ack = testRand();
+        f->tsVal = testRand() | 1;
+        f->tsEcr = testRand() | 1;
+        f->win = 0xffff;
+        f->ipId = (UInt16)testRand();
+    }
+    /* Pairs of flows with the same addresses and ports on different VLANs. */
+    genFlows[9] = genFlows[8];
+    genFlows[9].id = 9;
+    genFlows[9].vlanTag = 100;
+    genFlows[10].vlanTag = 200;
+    genFlows[11] = genFlows[10];
+    genFlows[11].id = 11;
+    genFlows[11].vlanTag = 300;
+    genFlows[7] = genFlows[6];
+    genFlows[7].id = 7;
+    genFlows[7].vlanTag = 7;
+}
+
+static void nextSeg(struct GenFlow *f, struct GenSeg *s, UInt32 payloadLen, UInt8 flags)
+{
+    memset(s, 0, sizeof(*s));
+
+    /* The peer's ack, window and clock move on now and then. */
+    if (testRandRange(0, 3) == 0)
+        f->ack += testRandRange(0, 3000);
+
+    if (testRandRange(0, 7) == 0)
+        f->win = (UInt16)testRandRange(1000, 65535);
+
+    if (testRandRange(0, 3) == 0)
+        f->tsVal += testRandRange(1, 10);
+
+    if (testRandRange(0, 7) == 0)
+        f->tsEcr += testRandRange(1, 10);
+
+    s->seq = f->seq;
+    s->payloadLen = payloadLen;
+    s->flags = flags;
+    s->ack = f->ack;
+    s->tsVal = f->tsVal;
+    s->tsEcr = f->tsEcr;
+    f->seq += payloadLen;
+}
+
+/* Generate a capture with kNumGenPackets frames. */
+static UInt32 generateCapture(UInt8 *buf)
+{
+    struct PcapWriter w;
+    struct GenSeg s, s2;
+    struct GenFlow *f, *twin;
+    UInt8 frame[kMaxFrameLen + 4];
+    UInt8 frame2[kMaxFrameLen + 4];
+    UInt64 usecs = 1000000;
+    UInt32 len, len2;
+    UInt32 count = 0;
+    UInt32 burst = 0;
+    UInt32 r;
+
+    initGenFlows();
+    pcapInit(&w, buf);
+
+    while (count < kNumGenPackets) {
+        /* Bursts of full sized segments of one flow exceed kRxLroMaxLen. */
+        if (burst) {
+            f = &genFlows[0];
+            burst--;
+            nextSeg(f, &s, 1448, TH_ACK);
+            len = addVlanTag(frame, buildTCPFrame(frame, f, &s), f->vlanTag);
+            pcapAdd(&w, usecs++, frame, len);
+            count++;
+            continue;
+        }
+        /* Gaps between packets end the rx runs. */
+        usecs += (testRandRange(0, 7) == 0) ? testRandRange(kRunGap, 1000) : testRandRange(1, 5);
+
+        if (testRandRange(0, 499) == 0) {
+            burst = testRandRange(40, 120);
+            continue;
+        }
+        f = &genFlows[(testRandRange(0, 1) ? testRandRange(0, 3) : testRandRange(0, kNumGenFlows - 1))];
+        r = testRandRange(0, 999);
+
+        if (r < 20) {
+            /* Retransmission of old data. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            f->seq -= s.payloadLen;
+            s.seq -= testRandRange(1, 20000);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 40) {
+            /* Two segments swapped. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            nextSeg(f, &s2, testRandRange(1, 1448), TH_ACK);
+            len2 = addVlanTag(frame2, buildTCPFrame(frame2, f, &s2), f->vlanTag);
+            pcapAdd(&w, usecs++, frame2, len2);
+            count++;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 90) {
+            /* Pure ack. */
+            nextSeg(f, &s, 0, TH_ACK);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 100) {
+            nextSeg(f, &s, testRandRange(0, 100), TH_ACK | TH_FIN);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 110) {
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK | TH_URG);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 120) {
+            /* An older ack. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.ack -= testRandRange(1, 100000);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 130) {
+            /* An older timestamp. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.tsVal -= testRandRange(1, 100);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 140) {
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.tos = IPTOS_ECN_CE;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 150) {
+            nextSeg(f, &s, testRandRange(1, 1400), TH_ACK);
+            s.ipOptLen = 4 * testRandRange(1, 10);
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 160) {
+            /* First fragment of a segment. */
+            nextSeg(f, &s, testRandRange(8, 1448) & ~7, TH_ACK);
+            s.ipOff = IP_MF;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 170) {
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.badTCPCsum = true;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 180) {
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.badIPCsum = true;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 190) {
+            /* A timestamp echo of 0 isn't accepted. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.tsEcr = 0;
+            len = buildTCPFrame(frame, f, &s);
+        } else if (r < 200) {
+            /* A segment without the options of its connection. */
+            nextSeg(f, &s, testRandRange(1, 1448), TH_ACK);
+            s.noOpts = true;
+            len = buildTCPFrame(frame, f, &s);
+        } else if ((r < 210) && (f->id >= 6)) {
+            /* The next segment of the same connection on another VLAN. */
+            twin = &genFlows[f->id ^ 1];
+            twin->seq = f->seq;
+            twin->ack = f->ack;
+            twin->tsVal = f->tsVal;
+            twin->tsEcr = f->tsEcr;
+            nextSeg(twin, &s, testRandRange(1, 1448), TH_ACK);
+            len = buildTCPFrame(frame, twin, &s);
+            f = twin;
+        } else if (r < 230) {
+            len = buildUDPFrame(frame, f, testRandRange(0, 1472));
+        } else if (r < 245) {
+            len = buildIPv6Frame(frame, f, testRandRange(0, 1440));
+        } else if (r < 250) {
+            len = buildARPFrame(frame);
+        } else {
+            nextSeg(f, &s, (testRandRange(0, 3) ? 1448 : testRandRange(1, 1448)), (testRandRange(0, 7) ? TH_ACK : (TH_ACK | TH_PUSH)));
+            len = buildTCPFrame(frame, f, &s);
+        }
+        len = addVlanTag(frame, len, f->vlanTag);
+        pcapAdd(&w, usecs, frame, len);
+        count++;
+    }
+    return w.len;
+}
+
+/* replay */
+
+/* Receive status of a frame as the hardware reports it. */
+static UInt32 frameStatus(const UInt8 *frame, UInt32 len)
+{
+    const UInt8 *ip = &frame[ETH_HLEN];
+    UInt32 ipHdrLen, ipLen, l4Len;
+    UInt32 status = 0;
+    UInt32 sum;
+    UInt8 proto;
+
+    if ((len < ETH_HLEN + 20) || (testGet16(&frame[12]) != ETHERTYPE_IP) || ((ip[0] >> 4) != 4))
+        goto done;
+
+    ipHdrLen = (ip[0] & 0x0f) << 2;
+    ipLen = testGet16(&ip[2]);
+
+    if ((ipHdrLen < 20) || (ipLen < ipHdrLen) || (ETH_HLEN + ipLen > len))
+        goto done;
+
+    status |= E1000_RXD_STAT_IPPCS;
+
+    if (testCsumFold(testCsumAdd(ip, ipHdrLen, 0)) != 0xffff)
+        status |= E1000_RXDEXT_STATERR_IPE;
+
+    /* No layer 4 checksum of fragments. */
+    if (testGet16(&ip[6]) & (IP_MF | IP_OFFMASK))
+        goto done;
+
+    proto = ip[9];
+
+    if ((proto != IPPROTO_TCP) && (proto != IPPROTO_UDP))
+        goto done;
+
+    l4Len = ipLen - ipHdrLen;
+    sum = testCsumAdd(&ip[12], 8, 0) + proto + l4Len;
+    sum = testCsumAdd(&ip[ipHdrLen], l4Len, sum);
+    status |= E1000_RXD_STAT_TCPCS;
+
+    if (testCsumFold(sum) != 0xffff)
+        status |= E1000_RXDEXT_STATERR_TCPE;
+
+done:
+    return status;
+}
+
+/* The TCP connection of a frame, or -1 for a frame which isn't TCP/IPv4. */
+static SInt32 frameKey(const UInt8 *frame, UInt32 len, UInt16 vlanTag, bool hasVlanTag, bool add)
+{
+    const UInt8 *ip = &frame[ETH_HLEN];
+    struct FlowKey k;
+    UInt32 ipHdrLen;
+    UInt32 i;
+
+    if ((len < ETH_HLEN + 20) || (testGet16(&frame[12]) != ETHERTYPE_IP) || ((ip[0] >> 4) != 4) || (ip[9] != IPPROTO_TCP))
+        return -1;
+
+    ipHdrLen = (ip[0] & 0x0f) << 2;
+
+    if ((ipHdrLen < 20) || (len < ETH_HLEN + ipHdrLen + 20))
+        return -1;
+
+    memset(&k, 0, sizeof(k));
+    memcpy(k.addrs, &ip[12], 8);
+    memcpy(k.ports, &ip[ipHdrLen], 4);
+    k.hasVlanTag = hasVlanTag;
+    k.vlanTag = hasVlanTag ? vlanTag : 0;
+
+    for (i = 0; i < numKeys; i++) {
+        if (!memcmp(&keys[i], &k, sizeof(k)))
+            return i;
+    }
+    if (!add || (numKeys == kMaxKeys))
+        return -1;
+
+    keys[numKeys] = k;
+    keyQueues[numKeys].head = keyQueues[numKeys].tail = -1;
+
+    return numKeys++;
+}
+
+static void queueAdd(struct Queue *q, SInt32 rec)
+{
+    records[rec].next = -1;
+
+    if (q->tail >= 0)
+        records[q->tail].next = rec;
+    else
+        q->head = rec;
+
+    q->tail = rec;
+}
+
+static SInt32 queuePop(struct Queue *q)
+{
+    SInt32 rec = q->head;
+
+    if (rec >= 0) {
+        q->head = records[rec].next;
+
+        if (q->head < 0)
+            q->tail = -1;
+    }
+    return rec;
+}
+
+/* Parse a pcap capture into records. Returns false in case it isn't one. */
+static bool loadCapture(const UInt8 *buf, UInt32 size)
+{
+    struct Record *r;
+    UInt32 offset = 24;
+    UInt32 inclLen;
+    UInt32 magic;
+    bool swap;
+
+    if (size < 24)
+        return false;
+
+    memcpy(&magic, buf, 4);
+
+    if (magic == kPcapMagic)
+        swap = false;
+    else if (magic == __builtin_bswap32(kPcapMagic))
+        swap = true;
+    else
+        return false;
+
+    if (get32(&buf[20], swap) != kLinkTypeEther)
+        return false;
+
+    numRecords = 0;
+    numKeys = 0;
+    otherQueue.head = otherQueue.tail = -1;
+
+    while ((offset + 16 <= size) && (numRecords < kMaxRecords)) {
+        inclLen = get32(&buf[offset + 8], swap);
+
+        if (offset + 16 + inclLen > size)
+            break;
+
+        /* Skip truncated and oversized frames. */
+        if ((inclLen != get32(&buf[offset + 12], swap)) || (inclLen < ETH_HLEN) || (inclLen > kMaxFrameLen + 4)) {
+            offset += 16 + inclLen;
+            continue;
+        }
+        r = &records[numRecords];
+        memset(r, 0, sizeof(*r));
+        memcpy(r->frame, &buf[offset + 16], inclLen);
+        r->len = inclLen;
+
+        /* The hardware strips the VLAN tag. */
+        if (testGet16(&r->frame[12]) == ETHERTYPE_VLAN) {
+            r->vlanTag = testGet16(&r->frame[14]);
+            r->hasVlanTag = true;
+            memmove(&r->frame[12], &r->frame[16], inclLen - 16);
+            r->len -= 4;
+        }
+        if (r->len > kMaxFrameLen) {
+            offset += 16 + inclLen;
+            continue;
+        }
+        r->status = frameStatus(r->frame, r->len);
+        r->key = frameKey(r->frame, r->len, r->vlanTag, r->hasVlanTag, true);
+        numRecords++;
+        offset += 16 + inclLen;
+    }
+    return true;
+}
+
+/*
+ * Put a frame into a chain of mbufs. The first one holds at least the
+ * longest IP and TCP headers like the header buffer of packet split
+ * receives, the rest is split at random.
+ */
+static mbuf_t makeChain(const struct Record *r, bool split)
+{
+    mbuf_t head = testMbufAlloc(true);
+    mbuf_t tail = head;
+    mbuf_t n;
+    UInt32 offset = 0;
+    UInt32 chunk;
+    UInt32 minHead = min(r->len, ETH_HLEN + 60 + 60);
+
+    while (offset < r->len) {
+        if (!split || testRandRange(0, 2) == 0)
+            chunk = r->len - offset;
+        else if (!offset)
+            chunk = testRandRange(minHead, r->len);
+        else
+            chunk = testRandRange(1, r->len - offset);
+
+        if (offset) {
+            n = testMbufAlloc(false);
+            mbuf_setnext(tail, n);
+            tail = n;
+        }
+        memcpy(tail->data, &r->frame[offset], chunk);
+        tail->len = chunk;
+        offset += chunk;
+    }
+    head->pktLen = r->len;
+
+    if (r->hasVlanTag)
+        mbuf_set_vlan_tag(head, r->vlanTag);
+
+    return head;
+}
+
+static UInt32 recordHash(const struct Record *r, bool useHash)
+{
+    UInt8 input[kRssInputLenTCPIPv4];
+
+    if (!useHash || !intelRssInputTCPIPv4(r->frame, r->len, input) || (r->frame[ETH_HLEN + 9] != IPPROTO_TCP))
+        return 0;
+
+    return intelToeplitzHash(rssKey, input, kRssInputLenTCPIPv4);
+}
+
+/* Linearize a packet handed up. Returns its length. */
+static UInt32 linearize(mbuf_t m, UInt8 *buf, UInt32 size)
+{
+    UInt32 len = 0;
+    mbuf_t n;
+
+    for (n = m; n; n = mbuf_next(n)) {
+        CHECK(len + mbuf_len(n) <= size);
+
+        if (len + mbuf_len(n) > size)
+            break;
+
+        memcpy(&buf[len], mbuf_data(n), mbuf_len(n));
+        len += mbuf_len(n);
+    }
+    return len;
+}
+
+struct TcpInfo {
+    UInt32 ipHdrLen;
+    UInt32 ipLen;
+    UInt32 tcpHdrLen;
+    UInt32 hdrLen;          /* from the start of the frame */
+    UInt32 payloadLen;
+    UInt32 seq;
+    UInt32 ack;
+    UInt16 win;
+    UInt8 flags;
+    bool hasTS;
+    UInt32 tsVal;
+    UInt32 tsEcr;
+};
+
+static void parseTcp(const UInt8 *frame, struct TcpInfo *t)
+{
+    const UInt8 *ip = &frame[ETH_HLEN];
+    const UInt8 *tcp;
+
+    t->ipHdrLen = (ip[0] & 0x0f) << 2;
+    t->ipLen = testGet16(&ip[2]);
+    tcp = &ip[t->ipHdrLen];
+    t->tcpHdrLen = (tcp[12] >> 4) << 2;
+    t->hdrLen = ETH_HLEN + t->ipHdrLen + t->tcpHdrLen;
+    t->payloadLen = t->ipLen - t->ipHdrLen - t->tcpHdrLen;
+    t->seq = ((UInt32)testGet16(&tcp[4]) << 16) | testGet16(&tcp[6]);
+    t->ack = ((UInt32)testGet16(&tcp[8]) << 16) | testGet16(&tcp[10]);
+    t->flags = tcp[13];
+    t->win = testGet16(&tcp[14]);
+    t->hasTS = (t->tcpHdrLen == 20 + kTSOptLen) && (tcp[20] == TCPOPT_NOP) && (tcp[21] == TCPOPT_NOP) &&
+               (tcp[22] == TCPOPT_TIMESTAMP) && (tcp[23] == TCPOLEN_TIMESTAMP);
+
+    if (t->hasTS) {
+        t->tsVal = ((UInt32)testGet16(&tcp[24]) << 16) | testGet16(&tcp[26]);
+        t->tsEcr = ((UInt32)testGet16(&tcp[28]) << 16) | testGet16(&tcp[30]);
+    }
+}
+
+/* Could the segment have been merged with its successor? */
+static bool mergeable(const struct Record *r, const struct TcpInfo *t, bool last)
+{
+    const UInt8 *ip = &r->frame[ETH_HLEN];
+
+    if ((r->status & (E1000_RXDEXT_STATERR_IPE | E1000_RXDEXT_STATERR_TCPE)) ||
+        !(r->status & E1000_RXD_STAT_IPPCS) || !(r->status & E1000_RXD_STAT_TCPCS))
+        return false;
+
+    if ((t->ipHdrLen != 20) || (testGet16(&ip[6]) & (IP_MF | IP_OFFMASK)) || ((ip[1] & IPTOS_ECN_MASK) == IPTOS_ECN_CE))
+        return false;
+
+    if ((t->tcpHdrLen != 20) && !(t->hasTS && t->tsEcr))
+        return false;
+
+    if (r->len != ETH_HLEN + t->ipLen || !t->payloadLen)
+        return false;
+
+    return ((t->flags & ~(last ? TH_PUSH : 0)) == TH_ACK);
+}
+
+/* Check a merged packet against the segments it has been built from. */
+static void checkMerged(const UInt8 *out, UInt32 outLen, struct Queue *q)
+{
+    struct TcpInfo o, first, t, prev;
+    const struct Record *r;
+    UInt32 payload = 0;
+    UInt32 segs = 0;
+    UInt8 flags = 0;
+    SInt32 rec;
+
+    parseTcp(out, &o);
+    CHECK(o.ipLen == outLen - ETH_HLEN);
+    CHECK(o.ipLen <= kRxLroMaxLen);
+    CHECK(testCsumFold(testCsumAdd(&out[ETH_HLEN], o.ipHdrLen, 0)) == 0xffff);
+
+    memset(&prev, 0, sizeof(prev));
+    memset(&first, 0, sizeof(first));
+
+    while (payload < o.payloadLen) {
+        rec = queuePop(q);
+        CHECK(rec >= 0);
+
+        if (rec < 0)
+            return;
+
+        r = &records[rec];
+        parseTcp(r->frame, &t);
+
+        if (!segs) {
+            first = t;
+
+            /* The headers of the first segment apart from the length. */
+            CHECK(!memcmp(out, r->frame, ETH_HLEN + 2));
+            CHECK(!memcmp(&out[ETH_HLEN + 4], &r->frame[ETH_HLEN + 4], 6));
+            CHECK(!memcmp(&out[ETH_HLEN + 12], &r->frame[ETH_HLEN + 12], 8));
+            CHECK(o.tcpHdrLen == t.tcpHdrLen);
+            CHECK(!memcmp(&out[ETH_HLEN + 20], &r->frame[ETH_HLEN + 20], 8));
+            CHECK(!memcmp(&out[ETH_HLEN + 32], &r->frame[ETH_HLEN + 32], 1));
+            CHECK(!memcmp(&out[ETH_HLEN + 36], &r->frame[ETH_HLEN + 36], 4));
+        } else {
+            /* In order with the same options and no older ack or timestamp. */
+            CHECK(t.seq == prev.seq + prev.payloadLen);
+            CHECK(t.tcpHdrLen == first.tcpHdrLen);
+            CHECK((SInt32)(t.ack - prev.ack) >= 0);
+
+            if (t.hasTS)
+                CHECK((SInt32)(t.tsVal - prev.tsVal) >= 0);
+        }
+        /* The payload must follow unchanged. */
+        CHECK(payload + t.payloadLen <= o.payloadLen);
+
+        if (payload + t.payloadLen > o.payloadLen)
+            return;
+
+        CHECK(!memcmp(&out[o.hdrLen + payload], &r->frame[t.hdrLen], t.payloadLen));
+
+        payload += t.payloadLen;
+        flags |= t.flags;
+        prev = t;
+        segs++;
+
+        CHECK(mergeable(r, &t, (payload == o.payloadLen)));
+    }
+    CHECK(segs > 1);
+
+    /* The state of the last segment. */
+    CHECK(o.seq == first.seq);
+    CHECK(o.ack == prev.ack);
+    CHECK(o.win == prev.win);
+    CHECK(o.flags == flags);
+    CHECK(o.hasTS == prev.hasTS);
+
+    if (o.hasTS) {
+        CHECK(o.tsVal == prev.tsVal);
+        CHECK(o.tsEcr == prev.tsEcr);
+    }
+    outMerged++;
+    outSegsMerged += segs;
+
+    if (o.ipLen > outMaxLen)
+        outMaxLen = o.ipLen;
+}
+
+/* Check the packets handed up and release them. */
+static void checkOutput(mbuf_t list)
+{
+    static UInt8 out[kRxLroMaxLen + ETH_HLEN];
+    const struct Record *r;
+    struct Queue *q;
+    mbuf_t m, next;
+    UInt32 len;
+    UInt16 vlanTag = 0;
+    bool hasVlanTag;
+    SInt32 key;
+    SInt32 rec;
+
+    for (m = list; m; m = next) {
+        next = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, NULL);
+
+        CHECK(mbuf_flags(m) & MBUF_PKTHDR);
+        len = linearize(m, out, sizeof(out));
+        CHECK(len == mbuf_pkthdr_len(m));
+
+        hasVlanTag = !mbuf_get_vlan_tag(m, &vlanTag);
+        key = frameKey(out, len, vlanTag, hasVlanTag, false);
+        q = (key >= 0) ? &keyQueues[key] : &otherQueue;
+        rec = q->head;
+        CHECK(rec >= 0);
+
+        if (rec >= 0) {
+            r = &records[rec];
+            CHECK(r->hasVlanTag == hasVlanTag);
+            CHECK(!hasVlanTag || (r->vlanTag == vlanTag));
+
+            /* Packets which haven't been merged come out unchanged. */
+            if ((r->len == len) && !memcmp(r->frame, out, len))
+                queuePop(q);
+            else if (key >= 0)
+                checkMerged(out, len, q);
+            else
+                CHECK(!"unexpected packet");
+        }
+        mbuf_freem(m);
+    }
+}
+
+/* Replay the records with rx runs separated by gaps in the capture. */
+static void replay(const UInt8 *buf, UInt32 size, bool split, bool useHash)
+{
+    struct intelLroTable lro;
+    const UInt8 *p;
+    UInt64 usecs, lastUsecs = 0;
+    UInt32 offset = 24;
+    UInt32 runLen = 0;
+    UInt32 i;
+    bool swap = (get32(buf, false) != kPcapMagic);
+
+    CHECK(loadCapture(buf, size));
+
+    for (i = 0; i < numRecords; i++) {
+        if (records[i].key >= 0)
+            queueAdd(&keyQueues[records[i].key], i);
+        else
+            queueAdd(&otherQueue, i);
+    }
+    memset(&lro, 0, sizeof(lro));
+    outMerged = outSegsMerged = outMaxLen = 0;
+
+    for (i = 0; i < numRecords; i++) {
+        /* Find the time stamp of the record. */
+        p = &buf[offset];
+        usecs = (UInt64)get32(p, swap) * 1000000 + get32(&p[4], swap);
+        offset += 16 + get32(&p[8], swap);
+
+        if ((i && ((usecs - lastUsecs) >= kRunGap)) || (runLen == kMaxRunLen)) {
+            checkOutput(intelLroFlushAll(&lro));
+            runLen = 0;
+        }
+        lastUsecs = usecs;
+        runLen++;
+
+        checkOutput(intelLroReceive(&lro, makeChain(&records[i], split), records[i].status, recordHash(&records[i], useHash)));
+    }
+    checkOutput(intelLroFlushAll(&lro));
+
+    /* Every packet has been handed up. */
+    CHECK(otherQueue.head < 0);
+
+    for (i = 0; i < numKeys; i++)
+        CHECK(keyQueues[i].head < 0);
+
+    CHECK(testMbufsLive == 0);
+    CHECK(lro.segments == lro.hits + lro.misses);
+    CHECK(lro.flushes == lro.misses);
+    CHECK(outSegsMerged <= lro.segments);
+
+    printf("replay (%s, %s): %u packets, %u merged packets from %u segments, %llu evictions, largest %u bytes\n",
+           split ? "split" : "linear", useHash ? "hash" : "no hash", numRecords, outMerged, outSegsMerged,
+           (unsigned long long)lro.evictions, outMaxLen);
+}
+
+static UInt8 *readFile(const char *path, UInt32 *size)
+{
+    FILE *file = fopen(path, "rb");
+    UInt8 *buf = NULL;
+    long len;
+
+    if (!file)
+        return NULL;
+
+    if (!fseek(file, 0, SEEK_END) && ((len = ftell(file)) > 0) && !fseek(file, 0, SEEK_SET)) {
+        buf = (UInt8 *)malloc(len);
+
+        if (buf && (fread(buf, 1, len, file) == (size_t)len)) {
+            *size = (UInt32)len;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(file);
+
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    UInt8 *buf = (UInt8 *)malloc(kPcapBufSize);
+    UInt8 *capture;
+    FILE *file;
+    UInt32 size;
+    UInt32 i;
+
+    for (i = 0; i < sizeof(rssKey); i++)
+        rssKey[i] = (UInt8)testRand();
+
+    size = generateCapture(buf);
+
+    if ((argc == 3) && !strcmp(argv[1], "-w")) {
+        file = fopen(argv[2], "wb");
+
+        if (!file || (fwrite(buf, 1, size, file) != size)) {
+            fprintf(stderr, "Failed to write %s.\n", argv[2]);
+            return 1;
+        }
+        fclose(file);
+        return 0;
+    }
+    replay(buf, size, false, true);
+    replay(buf, size, true, true);
+    replay(buf, size, true, false);
+
+    /* The generated capture must have exercised merging and eviction. */
+    CHECK(outMerged > 1000);
+    CHECK(outMaxLen > kRxLroMaxLen - 1448);
+
+    for (i = 1; i < (UInt32)argc; i++) {
+        capture = readFile(argv[i], &size);
+
+        if (!capture || !loadCapture(capture, size)) {
+            fprintf(stderr, "%s isn't an ethernet pcap capture.\n", argv[i]);
+            testFailures++;
+        } else {
+            replay(capture, size, true, true);
+        }
+        free(capture);
+    }
+    free(buf);
+
+    return testResult("LROTests");
+}
@@ -0,0 +1,172 @@
+/* MbufSupport.h -- Model of the mbuf KPI for the IntelMausi tests.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Implements the subset of kpi_mbuf.h used by the driver's shared code with
+ * the semantics of xnu: mbuf_adj() trims from the front of a chain and
+ * leaves emptied mbufs in place, mbuf_free() returns the next mbuf of the
+ * chain and only a packet header mbuf carries a packet length and a VLAN
+ * tag. Live mbufs are counted so that tests can check for leaks.
+ */
+
+#ifndef _MBUFSUPPORT_H
+#define _MBUFSUPPORT_H
+
+#include <errno.h>
+
+typedef int errno_t;
+typedef UInt32 mbuf_flags_t;
+
+#define MBUF_PKTHDR     0x0002
+
+#define kTestMbufSize   2048
+
+struct __mbuf {
+    mbuf_t next;
+    mbuf_t nextpkt;
+    UInt8 *data;
+    size_t len;
+    mbuf_flags_t flags;
+    size_t pktLen;
+    UInt16 vlanTag;
+    bool hasVlanTag;
+    UInt8 buffer[kTestMbufSize];
+};
+
+static int testMbufsLive;
+
+static inline mbuf_t testMbufAlloc(bool pktHdr)
+{
+    mbuf_t m = (mbuf_t)calloc(1, sizeof(struct __mbuf));
+
+    if (!m)
+        abort();
+
+    m->data = m->buffer;
+    m->flags = pktHdr ? MBUF_PKTHDR : 0;
+    testMbufsLive++;
+
+    return m;
+}
+
+static inline void *mbuf_data(mbuf_t m)
+{
+    return m->data;
+}
+
+static inline size_t mbuf_len(mbuf_t m)
+{
+    return m->len;
+}
+
+static inline mbuf_t mbuf_next(mbuf_t m)
+{
+    return m->next;
+}
+
+static inline errno_t mbuf_setnext(mbuf_t m, mbuf_t next)
+{
+    m->next = next;
+    return 0;
+}
+
+static inline mbuf_t mbuf_nextpkt(mbuf_t m)
+{
+    return m->nextpkt;
+}
+
+static inline void mbuf_setnextpkt(mbuf_t m, mbuf_t nextpkt)
+{
+    m->nextpkt = nextpkt;
+}
+
+static inline mbuf_flags_t mbuf_flags(mbuf_t m)
+{
+    return m->flags;
+}
+
+static inline errno_t mbuf_setflags_mask(mbuf_t m, mbuf_flags_t flags, mbuf_flags_t mask)
+{
+    m->flags = (m->flags & ~mask) | (flags & mask);
+
+    if (!(m->flags & MBUF_PKTHDR)) {
+        m->pktLen = 0;
+        m->hasVlanTag = false;
+    }
+    return 0;
+}
+
+static inline size_t mbuf_pkthdr_len(mbuf_t m)
+{
+    return (m->flags & MBUF_PKTHDR) ? m->pktLen : 0;
+}
+
+static inline void mbuf_pkthdr_setlen(mbuf_t m, size_t len)
+{
+    if (!(m->flags & MBUF_PKTHDR))
+        abort();
+
+    m->pktLen = len;
+}
+
+static inline errno_t mbuf_get_vlan_tag(mbuf_t m, UInt16 *vlan)
+{
+    if (!(m->flags & MBUF_PKTHDR) || !m->hasVlanTag)
+        return ENXIO;
+
+    *vlan = m->vlanTag;
+    return 0;
+}
+
+static inline errno_t mbuf_set_vlan_tag(mbuf_t m, UInt16 vlan)
+{
+    if (!(m->flags & MBUF_PKTHDR))
+        return EINVAL;
+
+    m->vlanTag = vlan;
+    m->hasVlanTag = true;
+    return 0;
+}
+
+/* Trim len bytes from the front of the chain. */
+static inline void mbuf_adj(mbuf_t m, int len)
+{
+    mbuf_t n;
+    size_t cut;
+
+    if (m->flags & MBUF_PKTHDR)
+        m->pktLen -= len;
+
+    for (n = m; n && len; n = n->next) {
+        cut = min((UInt32)n->len, (UInt32)len);
+        n->data += cut;
+        n->len -= cut;
+        len -= (int)cut;
+    }
+}
+
+static inline mbuf_t mbuf_free(mbuf_t m)
+{
+    mbuf_t next = m->next;
+
+    free(m);
+    testMbufsLive--;
+
+    return next;
+}
+
+static inline void mbuf_freem(mbuf_t m)
+{
+    while (m)
+        m = mbuf_free(m);
+}
+
+#endif /* _MBUFSUPPORT_H */
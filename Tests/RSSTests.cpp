@@ -0,0 +1,151 @@
+/* RSSTests.cpp -- Tests of the software reference of the RSS hash.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * intelToeplitzHash() is checked against the verification vectors of
+ * Microsoft's RSS specification and against the definition of the hash
+ * for random keys and inputs. intelRssInputTCPIPv4() must pick the
+ * addresses and ports from frames with and without IP options.
+ */
+
+#include "TestSupport.h"
+#include "IntelMausiRSS.h"
+
+/* Verification key and IPv4 vectors from Microsoft's RSS specification. */
+static const UInt8 rssTestKey[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+static const struct {
+    UInt8 input[12];    /* source and destination address, source and destination port */
+    UInt32 hashIP;
+    UInt32 hashTCP;
+} rssTestVectors[] = {
+    { { 66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6 }, 0x323e8fc2, 0x51ccc178 },
+    { { 199, 92, 111, 2, 65, 69, 140, 83, 0x37, 0x96, 0x12, 0x83 }, 0xd718262a, 0xc626b0ea },
+    { { 24, 19, 198, 95, 12, 22, 207, 184, 0x32, 0x62, 0x94, 0x88 }, 0xd2d0a5de, 0x5c2b394a },
+    { { 38, 27, 205, 30, 209, 142, 163, 6, 0xbc, 0x64, 0x08, 0xa9 }, 0x82989176, 0xafc7327f },
+    { { 153, 39, 163, 191, 202, 188, 127, 2, 0xac, 0xdb, 0x05, 0x17 }, 0x5d1809c5, 0x10e828a2 },
+};
+
+#define kNumTestVectors (sizeof(rssTestVectors) / sizeof(rssTestVectors[0]))
+
+static void testVectors()
+{
+    UInt32 i;
+
+    for (i = 0; i < kNumTestVectors; i++) {
+        CHECK(intelToeplitzHash(rssTestKey, rssTestVectors[i].input, kRssInputLenIPv4) == rssTestVectors[i].hashIP);
+        CHECK(intelToeplitzHash(rssTestKey, rssTestVectors[i].input, kRssInputLenTCPIPv4) == rssTestVectors[i].hashTCP);
+    }
+}
+
+static UInt32 keyBit(const UInt8 *key, UInt32 bit)
+{
+    return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/*
+ * The definition of the hash: for each set bit i of the input the 32 bits
+ * of the key starting at bit i are XORed into the result.
+ */
+static UInt32 refToeplitzHash(const UInt8 *key, const UInt8 *data, UInt32 len)
+{
+    UInt32 hash = 0;
+    UInt32 window;
+    UInt32 i, j;
+
+    for (i = 0; i < len * 8; i++) {
+        if (!keyBit(data, i))
+            continue;
+
+        window = 0;
+
+        for (j = 0; j < 32; j++)
+            window = (window << 1) | keyBit(key, i + j);
+
+        hash ^= window;
+    }
+    return hash;
+}
+
+static void testRandom()
+{
+    UInt8 key[40];
+    UInt8 input[36];
+    UInt32 len;
+    UInt32 n, i;
+
+    for (n = 0; n < 20000; n++) {
+        for (i = 0; i < sizeof(key); i++)
+            key[i] = (UInt8)testRand();
+
+        len = testRandRange(1, sizeof(input));
+
+        for (i = 0; i < len; i++)
+            input[i] = (UInt8)testRand();
+
+        CHECK(intelToeplitzHash(key, input, len) == refToeplitzHash(key, input, len));
+    }
+}
+
+static UInt32 buildFrame(UInt8 *frame, UInt32 vector, UInt32 optLen, UInt16 etherType)
+{
+    UInt32 l4Offset = ETH_HLEN + 20 + optLen;
+
+    memset(frame, 0, l4Offset + 20);
+    testPut16(&frame[12], etherType);
+    frame[ETH_HLEN] = 0x40 | ((20 + optLen) >> 2);
+    frame[ETH_HLEN + 9] = IPPROTO_TCP;
+    memcpy(&frame[ETH_HLEN + 12], rssTestVectors[vector].input, 8);
+    memcpy(&frame[l4Offset], &rssTestVectors[vector].input[8], 4);
+
+    return l4Offset + 20;
+}
+
+static void testInput()
+{
+    UInt8 frame[128];
+    UInt8 input[kRssInputLenTCPIPv4];
+    UInt32 len;
+    UInt32 i, optLen;
+
+    for (i = 0; i < kNumTestVectors; i++) {
+        for (optLen = 0; optLen <= 40; optLen += 4) {
+            len = buildFrame(frame, i, optLen, ETHERTYPE_IP);
+
+            memset(input, 0, sizeof(input));
+            CHECK(intelRssInputTCPIPv4(frame, len, input));
+            CHECK(memcmp(input, rssTestVectors[i].input, sizeof(input)) == 0);
+            CHECK(intelToeplitzHash(rssTestKey, input, kRssInputLenTCPIPv4) == rssTestVectors[i].hashTCP);
+
+            /* The ports must be inside the frame. */
+            CHECK(intelRssInputTCPIPv4(frame, ETH_HLEN + 20 + optLen + 4, input));
+            CHECK(!intelRssInputTCPIPv4(frame, ETH_HLEN + 20 + optLen + 3, input));
+        }
+    }
+    len = buildFrame(frame, 0, 0, 0x86dd);
+    CHECK(!intelRssInputTCPIPv4(frame, len, input));
+    CHECK(!intelRssInputTCPIPv4(frame, ETH_HLEN + 19, input));
+}
+
+int main()
+{
+    testVectors();
+    testRandom();
+    testInput();
+
+    return testResult("RSSTests");
+}
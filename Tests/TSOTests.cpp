@@ -0,0 +1,363 @@
+/* TSOTests.cpp -- Tests of the TCP segmentation header helpers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The headers of each segment are compared with a reference segmentation
+ * which builds every segment from scratch and computes all lengths and
+ * checksums in software. The hardware's part of TSO is modeled after the
+ * datasheet: it fills in the length fields, increments the IP ID and the
+ * sequence number, clears FIN and PSH but in the last segment and adds the
+ * segment's TCP length to the checksum seed. Software segments are sent
+ * with checksum offload: the hardware computes the IP checksum and folds
+ * the TCP header and payload into the seeded TCP checksum.
+ */
+
+#include "TestSupport.h"
+#include "IntelMausiTSO.h"
+
+#define kTestMaxPktLen  (ETH_HLEN + 65535)
+#define kTestIterations 2000
+
+struct TestPacket {
+    UInt8 data[kTestMaxPktLen];
+    UInt32 len;
+    UInt32 l4Offset;
+    UInt32 hdrLen;
+    bool ipv4;
+};
+
+static TestPacket testPkt;
+static UInt8 refSeg[kTestMaxPktLen];
+static UInt8 testSeg[kTestMaxPktLen];
+
+static void buildPacket(TestPacket *p, bool ipv4, UInt32 optLen, UInt32 payloadLen, UInt8 flags)
+{
+    UInt8 *d = p->data;
+    UInt8 *tcp;
+    UInt32 i;
+
+    p->ipv4 = ipv4;
+    p->l4Offset = ETH_HLEN + (ipv4 ? 20 : 40);
+    p->hdrLen = p->l4Offset + 20 + optLen;
+    p->len = p->hdrLen + payloadLen;
+
+    memset(d, 0, p->hdrLen);
+
+    for (i = 0; i < 12; i++)
+        d[i] = (UInt8)testRand();
+
+    if (ipv4) {
+        testPut16(&d[12], 0x0800);
+        d[14] = 0x45;
+        testPut16(&d[16], p->len - ETH_HLEN);
+        testPut16(&d[18], (UInt16)testRand());
+        testPut16(&d[20], 0x4000);
+        d[22] = 64;
+        d[23] = IPPROTO_TCP;
+
+        for (i = 26; i < 34; i++)
+            d[i] = (UInt8)testRand();
+
+        testPut16(&d[24], (UInt16)~testCsumFold(testCsumAdd(&d[ETH_HLEN], 20, 0)));
+    } else {
+        testPut16(&d[12], 0x86dd);
+        d[14] = 0x60;
+        testPut16(&d[18], p->len - p->l4Offset);
+        d[20] = IPPROTO_TCP;
+        d[21] = 64;
+
+        for (i = 22; i < 54; i++)
+            d[i] = (UInt8)testRand();
+    }
+    tcp = &d[p->l4Offset];
+
+    for (i = 0; i < 12; i++)
+        tcp[i] = (UInt8)testRand();
+
+    tcp[12] = (UInt8)(((20 + optLen) >> 2) << 4);
+    tcp[13] = flags;
+    testPut16(&tcp[14], (UInt16)testRand());
+
+    if (optLen) {
+        tcp[20] = TCPOPT_NOP;
+        tcp[21] = TCPOPT_NOP;
+        tcp[22] = TCPOPT_TIMESTAMP;
+        tcp[23] = TCPOLEN_TIMESTAMP;
+
+        for (i = 24; i < 32; i++)
+            tcp[i] = (UInt8)testRand();
+    }
+    for (i = p->hdrLen; i < p->len; i++)
+        d[i] = (UInt8)testRand();
+}
+
+static UInt32 numSegments(const TestPacket *p, UInt32 mss)
+{
+    return (p->len - p->hdrLen + mss - 1) / mss;
+}
+
+static UInt32 segmentLength(const TestPacket *p, UInt32 mss, UInt32 k)
+{
+    return min(mss, p->len - p->hdrLen - k * mss);
+}
+
+static void put32(UInt8 *p, UInt32 val)
+{
+    testPut16(p, (UInt16)(val >> 16));
+    testPut16(&p[2], (UInt16)val);
+}
+
+static UInt32 get32(const UInt8 *p)
+{
+    return ((UInt32)testGet16(p) << 16) | testGet16(&p[2]);
+}
+
+/* Build segment k of p from scratch. */
+static UInt32 refSegment(const TestPacket *p, UInt32 mss, UInt32 k, UInt8 *out)
+{
+    UInt32 segLen = segmentLength(p, mss, k);
+    UInt32 tcpLen = p->hdrLen - p->l4Offset + segLen;
+    UInt8 *tcp = &out[p->l4Offset];
+    UInt32 sum;
+
+    memcpy(out, p->data, p->hdrLen);
+    memcpy(&out[p->hdrLen], &p->data[p->hdrLen + k * mss], segLen);
+
+    if (p->ipv4) {
+        testPut16(&out[16], (UInt16)(p->hdrLen - ETH_HLEN + segLen));
+        testPut16(&out[18], (UInt16)(testGet16(&p->data[18]) + k));
+        testPut16(&out[24], 0);
+        testPut16(&out[24], (UInt16)~testCsumFold(testCsumAdd(&out[ETH_HLEN], 20, 0)));
+        sum = testCsumAdd(&out[26], 8, IPPROTO_TCP + tcpLen);
+    } else {
+        testPut16(&out[18], (UInt16)tcpLen);
+        sum = testCsumAdd(&out[22], 32, IPPROTO_TCP + tcpLen);
+    }
+    put32(&tcp[4], get32(&p->data[p->l4Offset + 4]) + k * mss);
+
+    if (k != (numSegments(p, mss) - 1))
+        tcp[13] &= ~(TH_FIN | TH_PUSH);
+
+    if (k)
+        tcp[13] &= ~TH_CWR;
+
+    testPut16(&tcp[16], 0);
+    testPut16(&tcp[16], (UInt16)~testCsumFold(testCsumAdd(tcp, tcpLen, sum)));
+
+    return p->hdrLen + segLen;
+}
+
+/* Build segment k the way the hardware does from the headers in hdr. */
+static UInt32 hwTSOSegment(const TestPacket *p, const UInt8 *hdr, UInt32 mss, UInt32 k, UInt8 *out)
+{
+    UInt32 segLen = segmentLength(p, mss, k);
+    UInt32 tcpLen = p->hdrLen - p->l4Offset + segLen;
+    UInt8 *tcp = &out[p->l4Offset];
+
+    memcpy(out, hdr, p->hdrLen);
+    memcpy(&out[p->hdrLen], &p->data[p->hdrLen + k * mss], segLen);
+
+    if (p->ipv4) {
+        testPut16(&out[16], (UInt16)(p->hdrLen - ETH_HLEN + segLen));
+        testPut16(&out[18], (UInt16)(testGet16(&hdr[18]) + k));
+        testPut16(&out[24], (UInt16)~testCsumFold(testCsumAdd(&out[ETH_HLEN], p->l4Offset - ETH_HLEN, 0)));
+    } else {
+        testPut16(&out[18], (UInt16)tcpLen);
+    }
+    put32(&tcp[4], get32(&hdr[p->l4Offset + 4]) + k * mss);
+
+    if (k != (numSegments(p, mss) - 1))
+        tcp[13] &= ~(TH_FIN | TH_PUSH);
+
+    testPut16(&tcp[16], (UInt16)~testCsumFold(testCsumAdd(tcp, tcpLen, tcpLen)));
+
+    return p->hdrLen + segLen;
+}
+
+/* Build segment k in software and complete it with checksum offload. */
+static UInt32 gsoSegment(const TestPacket *p, const UInt8 *hdr, UInt32 csumBase, UInt32 mss, UInt32 k, UInt8 *out)
+{
+    UInt32 segLen = segmentLength(p, mss, k);
+    UInt32 tcpLen = p->hdrLen - p->l4Offset + segLen;
+    UInt8 *tcp = &out[p->l4Offset];
+
+    intelGSOBuildHeaders(out, hdr, p->hdrLen, p->l4Offset, p->ipv4, csumBase,
+                         k, numSegments(p, mss) - 1, k * mss, segLen);
+    memcpy(&out[p->hdrLen], &p->data[p->hdrLen + k * mss], segLen);
+
+    if (p->ipv4)
+        testPut16(&out[24], (UInt16)~testCsumFold(testCsumAdd(&out[ETH_HLEN], p->l4Offset - ETH_HLEN, 0)));
+
+    testPut16(&tcp[16], (UInt16)~testCsumFold(testCsumAdd(tcp, tcpLen, 0)));
+
+    return p->hdrLen + segLen;
+}
+
+static void testParseHeaders()
+{
+    UInt32 l4Offset = 0;
+    UInt32 hdrLen = 0;
+
+    buildPacket(&testPkt, true, 0, 100, TH_ACK);
+    CHECK(intelTSOParseHeaders(testPkt.data, testPkt.len, true, &l4Offset, &hdrLen));
+    CHECK((l4Offset == 34) && (hdrLen == 54));
+
+    buildPacket(&testPkt, true, 12, 100, TH_ACK);
+    CHECK(intelTSOParseHeaders(testPkt.data, testPkt.len, true, &l4Offset, &hdrLen));
+    CHECK((l4Offset == 34) && (hdrLen == 66));
+
+    /* The whole header must have been copied. */
+    CHECK(!intelTSOParseHeaders(testPkt.data, 65, true, &l4Offset, &hdrLen));
+    CHECK(!intelTSOParseHeaders(testPkt.data, 33, true, &l4Offset, &hdrLen));
+
+    buildPacket(&testPkt, false, 12, 100, TH_ACK);
+    CHECK(intelTSOParseHeaders(testPkt.data, testPkt.len, false, &l4Offset, &hdrLen));
+    CHECK((l4Offset == 54) && (hdrLen == 86));
+
+    /* IP options move the TCP header. */
+    buildPacket(&testPkt, true, 0, 100, TH_ACK);
+    testPkt.data[14] = 0x46;
+    testPkt.data[38 + 12] = 0x50;
+    CHECK(intelTSOParseHeaders(testPkt.data, testPkt.len, true, &l4Offset, &hdrLen));
+    CHECK((l4Offset == 38) && (hdrLen == 58));
+
+    /* A bogus IP header length and other protocols are rejected. */
+    testPkt.data[14] = 0x44;
+    CHECK(!intelTSOParseHeaders(testPkt.data, testPkt.len, true, &l4Offset, &hdrLen));
+
+    buildPacket(&testPkt, true, 0, 100, TH_ACK);
+    testPkt.data[23] = IPPROTO_UDP;
+    CHECK(!intelTSOParseHeaders(testPkt.data, testPkt.len, true, &l4Offset, &hdrLen));
+
+    buildPacket(&testPkt, false, 0, 100, TH_ACK);
+    testPkt.data[20] = IPPROTO_UDP;
+    CHECK(!intelTSOParseHeaders(testPkt.data, testPkt.len, false, &l4Offset, &hdrLen));
+}
+
+static void testGeometry()
+{
+    IOPhysicalSegment segs[kMaxSegs];
+    UInt32 i;
+
+    for (i = 0; i < kMaxSegs; i++) {
+        segs[i].location = 0x10000 * (i + 1);
+        segs[i].length = 2048;
+    }
+    CHECK(intelTSOCheckGeometry(segs, 1, 54));
+    CHECK(intelTSOCheckGeometry(segs, kTSOMaxSegs, 54));
+    CHECK(!intelTSOCheckGeometry(segs, kTSOMaxSegs + 1, 54));
+
+    /* Header split across the first two buffers */
+    segs[0].length = 40;
+    CHECK(!intelTSOCheckGeometry(segs, 4, 54));
+    segs[0].length = 54;
+    CHECK(intelTSOCheckGeometry(segs, 4, 54));
+
+    /* Tiny last buffer */
+    segs[3].length = kTSOMinTailLen;
+    CHECK(!intelTSOCheckGeometry(segs, 4, 54));
+    segs[3].length = kTSOMinTailLen + 1;
+    CHECK(intelTSOCheckGeometry(segs, 4, 54));
+
+    /* A single buffer may be small as long as it holds the header. */
+    segs[0].length = 60;
+    CHECK(intelTSOCheckGeometry(segs, 1, 54));
+}
+
+static void testHardwareTSO()
+{
+    UInt8 hdr[kTSOMaxHdrLen];
+    UInt32 iter, k, mss, len;
+    UInt32 mismatches = 0;
+    UInt32 segments = 0;
+    UInt8 flags;
+    bool ipv4;
+
+    for (iter = 0; iter < kTestIterations; iter++) {
+        ipv4 = (iter & 1);
+        mss = testRandRange(536, 1460);
+
+        /* Hardware TSO isn't used for packets with CWR. */
+        flags = TH_ACK | (testRand() & (TH_FIN | TH_PUSH));
+        buildPacket(&testPkt, ipv4, (iter & 2) ? 12 : 0, testRandRange(mss + 1, 65535 - 40 - 32), flags);
+
+        memcpy(hdr, testPkt.data, testPkt.hdrLen);
+        intelTSOSetupHeaders(hdr, testPkt.l4Offset, ipv4);
+
+        for (k = 0; k < numSegments(&testPkt, mss); k++) {
+            len = refSegment(&testPkt, mss, k, refSeg);
+
+            if ((hwTSOSegment(&testPkt, hdr, mss, k, testSeg) != len) || memcmp(refSeg, testSeg, len)) {
+                if (!mismatches)
+                    fprintf(stderr, "TSO mismatch: ipv4 %d, mss %u, segment %u\n", ipv4, mss, k);
+
+                mismatches++;
+            }
+            segments++;
+        }
+    }
+    CHECK(mismatches == 0);
+    printf("hardware TSO: %u packets, %u segments, %u mismatches\n", kTestIterations, segments, mismatches);
+}
+
+static void testSoftwareGSO()
+{
+    UInt8 hdr[kTSOMaxHdrLen];
+    UInt32 iter, k, mss, len, csumBase;
+    UInt32 mismatches = 0;
+    UInt32 segments = 0;
+    UInt32 numSegs;
+    UInt8 flags;
+    bool ipv4;
+
+    for (iter = 0; iter < kTestIterations; iter++) {
+        ipv4 = (iter & 1);
+        mss = testRandRange(536, 1460);
+        flags = TH_ACK | (testRand() & (TH_FIN | TH_PUSH | TH_CWR | TH_ECE));
+        buildPacket(&testPkt, ipv4, (iter & 2) ? 12 : 0, testRandRange(mss + 1, 65535 - 40 - 32), flags);
+
+        /* Let the IP ID and the sequence number wrap now and then. */
+        if (ipv4 && (iter & 4))
+            testPut16(&testPkt.data[18], (UInt16)(0xffff - (testRand() & 0x1f)));
+
+        if (iter & 8)
+            put32(&testPkt.data[testPkt.l4Offset + 4], 0xffffffff - (testRand() & 0xffff));
+
+        memcpy(hdr, testPkt.data, testPkt.hdrLen);
+        csumBase = intelGSOSetupHeaders(hdr, ipv4);
+        numSegs = numSegments(&testPkt, mss);
+
+        /* Batches may start at any segment, so build them in reverse order. */
+        for (k = numSegs; k-- > 0; ) {
+            len = refSegment(&testPkt, mss, k, refSeg);
+
+            if ((gsoSegment(&testPkt, hdr, csumBase, mss, k, testSeg) != len) || memcmp(refSeg, testSeg, len)) {
+                if (!mismatches)
+                    fprintf(stderr, "GSO mismatch: ipv4 %d, mss %u, segment %u\n", ipv4, mss, k);
+
+                mismatches++;
+            }
+            segments++;
+        }
+    }
+    CHECK(mismatches == 0);
+    printf("software GSO: %u packets, %u segments, %u mismatches\n", kTestIterations, segments, mismatches);
+}
+
+int main()
+{
+    testParseHeaders();
+    testGeometry();
+    testHardwareTSO();
+    testSoftwareGSO();
+
+    return testResult("TSOTests");
+}
@@ -0,0 +1,212 @@
+/* TestSupport.h -- User space environment for the IntelMausi tests.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The driver's headers which don't depend on IOKit are built against the
+ * definitions below. The constants mirror IntelMausiEthernet.h.
+ */
+
+#ifndef _TESTSUPPORT_H
+#define _TESTSUPPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "defines.h"
+
+typedef uint8_t     UInt8;
+typedef uint16_t    UInt16;
+typedef uint32_t    UInt32;
+typedef uint64_t    UInt64;
+typedef int8_t      SInt8;
+typedef int16_t     SInt16;
+typedef int32_t     SInt32;
+typedef int64_t     SInt64;
+
+struct IOPhysicalSegment {
+    UInt64 location;
+    UInt64 length;
+};
+
+typedef struct __mbuf *mbuf_t;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define OSSwapHostToLittleInt32(x)  ((UInt32)(x))
+#define OSSwapHostToLittleInt64(x)  ((UInt64)(x))
+#define OSSwapLittleToHostInt32(x)  ((UInt32)(x))
+#else
+#define OSSwapHostToLittleInt32(x)  __builtin_bswap32((UInt32)(x))
+#define OSSwapHostToLittleInt64(x)  __builtin_bswap64((UInt64)(x))
+#define OSSwapLittleToHostInt32(x)  __builtin_bswap32((UInt32)(x))
+#endif
+
+/* Descriptor layouts of hw.h which can't be included without the kernel headers. */
+struct e1000_context_desc {
+    union {
+        UInt32 ip_config;
+    } lower_setup;
+    union {
+        UInt32 tcp_config;
+    } upper_setup;
+    UInt32 cmd_and_length;
+    union {
+        UInt32 data;
+    } tcp_seg_setup;
+};
+
+struct e1000_data_desc {
+    UInt64 buffer_addr;
+    union {
+        UInt32 data;
+    } lower;
+    union {
+        UInt32 data;
+    } upper;
+};
+
+/* Checksum offload flags of IONetworkController. */
+enum {
+    kChecksumIP         = 0x0001,
+    kChecksumTCP        = 0x0002,
+    kChecksumUDP        = 0x0004,
+    kChecksumTCPIPv6    = 0x0020,
+    kChecksumUDPIPv6    = 0x0040,
+};
+
+#ifndef TH_ECE
+#define TH_ECE  0x40
+#endif
+
+#ifndef TH_CWR
+#define TH_CWR  0x80
+#endif
+
+#define ETH_HLEN            14
+#define kMaxSegs            40
+#define kMinL4HdrOffsetV4   34
+#define kMinL4HdrOffsetV6   54
+
+#define E1000_RXD_STAT_IPPCS        0x40
+#define E1000_RXDEXT_STATERR_TCPE   0x20000000
+#define E1000_RXDEXT_STATERR_IPE    0x40000000
+
+#define E1000_TX_FLAGS_VLAN_SHIFT   16
+#define E1000_TXD_OPTS_IXSM         0x00000100
+#define E1000_TXD_OPTS_TXSM         0x00000200
+
+#define kIPv4CSumStart      ETH_HLEN
+#define kIPv4CSumOffset     (offsetof(struct ip, ip_sum) + kIPv4CSumStart)
+#define kIPv4CSumEnd        (sizeof(struct ip) + kIPv4CSumStart - 1)
+
+#define kUDPv4CSumStart     kMinL4HdrOffsetV4
+#define kUDPv4CSumOffset    (offsetof(struct udphdr, uh_sum) + kMinL4HdrOffsetV4)
+#define kUDPv4CSumEnd       0
+
+#define kTCPv4CSumStart     kMinL4HdrOffsetV4
+#define kTCPv4CSumOffset    (offsetof(struct tcphdr, th_sum) + kMinL4HdrOffsetV4)
+#define kTCPv4CSumEnd       0
+
+#define kIPv6CSumStart      ETH_HLEN
+#define kIPv6CSumOffset     0
+#define kIPv6CSumEnd        0
+
+#define kTCPv6CSumStart     kMinL4HdrOffsetV6
+#define kTCPv6CSumOffset    (offsetof(struct tcphdr, th_sum) + kMinL4HdrOffsetV6)
+#define kTCPv6CSumEnd       0
+
+#define kUDPv6CSumStart     kMinL4HdrOffsetV6
+#define kUDPv6CSumOffset    (offsetof(struct udphdr, uh_sum) + kMinL4HdrOffsetV6)
+#define kUDPv6CSumEnd       0
+
+#define DebugLog(args...)
+
+static inline UInt32 min(UInt32 a, UInt32 b)
+{
+    return (a < b) ? a : b;
+}
+
+static int testFailures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        testFailures++; \
+    } \
+} while (0)
+
+static inline int testResult(const char *name)
+{
+    printf("%s: %s\n", name, testFailures ? "FAILED" : "passed");
+    return testFailures ? 1 : 0;
+}
+
+/* Deterministic pseudo random numbers so that failures can be reproduced. */
+static UInt32 testRandState = 0x12345678;
+
+static inline UInt32 testRand()
+{
+    testRandState ^= testRandState << 13;
+    testRandState ^= testRandState >> 17;
+    testRandState ^= testRandState << 5;
+
+    return testRandState;
+}
+
+static inline UInt32 testRandRange(UInt32 lo, UInt32 hi)
+{
+    return lo + testRand() % (hi - lo + 1);
+}
+
+/* One's complement sum of big endian 16 bit words as the hardware computes it. */
+static inline UInt32 testCsumAdd(const UInt8 *p, UInt32 len, UInt32 sum)
+{
+    UInt32 i;
+
+    for (i = 0; (i + 1) < len; i += 2)
+        sum += (p[i] << 8) | p[i + 1];
+
+    if (len & 1)
+        sum += p[len - 1] << 8;
+
+    return sum;
+}
+
+static inline UInt16 testCsumFold(UInt32 sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return (UInt16)sum;
+}
+
+static inline void testPut16(UInt8 *p, UInt16 val)
+{
+    p[0] = (UInt8)(val >> 8);
+    p[1] = (UInt8)val;
+}
+
+static inline UInt16 testGet16(const UInt8 *p)
+{
+    return (UInt16)((p[0] << 8) | p[1]);
+}
+
+#endif /* _TESTSUPPORT_H */
@@ -0,0 +1,382 @@
+/* TxBench.cpp -- Micro-benchmark of the tx descriptor builder.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Compares the table driven builder of IntelMausiTx.h with the builder of
+ * version 1.0.8 which selected the offload parameters with an if-chain,
+ * wrote a context descriptor for every offloaded packet and branched on
+ * the last segment in the data descriptor loop. Both builders first have
+ * to produce the same data descriptors for a random packet mix. Then they
+ * are timed writing the same mix to a ring of kRingSize descriptors.
+ *
+ * The ring lives in cached memory while the driver's ring is uncached
+ * device memory, so that the numbers show the cost of the builder itself
+ * and not of the PCIe writes which both versions have in common.
+ */
+
+#include <time.h>
+#include "TestSupport.h"
+#include "IntelMausiTx.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define kRingSize       1024
+#define kRingMask       (kRingSize - 1)
+#define kNumPackets     4096
+#define kBenchRounds    2000
+#define kCompareRounds  20000
+
+struct TestTxPacket {
+    mbuf_t m;
+    UInt32 offloadFlags;
+    UInt32 vlanTag;         /* 0 means untagged */
+    UInt32 numSegs;
+    IOPhysicalSegment segs[4];
+};
+
+static struct e1000_data_desc ringDescs[kRingSize];
+static struct intelTxBufferInfo ringBufs[kRingSize];
+static struct TestTxPacket packets[kNumPackets];
+
+/*
+ * The builder of version 1.0.8. Returns the number of descriptors used.
+ */
+static UInt32 oldTxWriteDescs(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, UInt32 index, UInt32 mask,
+                              const struct TestTxPacket *p)
+{
+    struct e1000_data_desc *desc;
+    struct e1000_context_desc *contDesc;
+    UInt32 offloadFlags = p->offloadFlags;
+    UInt32 numDescs = 0;
+    UInt32 cmd = 0;
+    UInt32 opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
+    UInt32 word2 = 0;
+    UInt32 len = 0;
+    UInt32 mss = 0;
+    UInt32 ipConfig = 0;
+    UInt32 tcpConfig = 0;
+    UInt32 word1;
+    UInt32 lastSeg;
+    UInt32 i;
+
+    if (offloadFlags & (kChecksumUDPIPv6 | kChecksumTCPIPv6 | kChecksumIP | kChecksumUDP | kChecksumTCP)) {
+        numDescs = 1;
+        cmd = (E1000_TXD_CMD_DEXT | E1000_TXD_DTYP_D);
+
+        if (offloadFlags & kChecksumTCP) {
+            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
+            tcpConfig = ((kTCPv4CSumEnd << 16) | (kTCPv4CSumOffset << 8) | kTCPv4CSumStart);
+            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP | E1000_TXD_CMD_TCP);
+            mss = 0;
+
+            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
+        } else if (offloadFlags & kChecksumUDP) {
+            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
+            tcpConfig = ((kUDPv4CSumEnd << 16) | (kUDPv4CSumOffset << 8) | kUDPv4CSumStart);
+            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
+            mss = 0;
+
+            word2 = (E1000_TXD_OPTS_TXSM | E1000_TXD_OPTS_IXSM);
+        } else if (offloadFlags & kChecksumIP) {
+            ipConfig = ((kIPv4CSumEnd << 16) | (kIPv4CSumOffset << 8) | kIPv4CSumStart);
+            tcpConfig = 0;
+            mss = 0;
+            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IP);
+
+            word2 = E1000_TXD_OPTS_IXSM;
+        } else if (offloadFlags & kChecksumTCPIPv6) {
+            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
+            tcpConfig = ((kTCPv6CSumEnd << 16) | (kTCPv6CSumOffset << 8) | kTCPv6CSumStart);
+            len = (E1000_TXD_CMD_DEXT | E1000_TXD_CMD_TCP);
+            mss = 0;
+
+            word2 = E1000_TXD_OPTS_TXSM;
+        } else if (offloadFlags & kChecksumUDPIPv6) {
+            ipConfig = ((kIPv6CSumEnd << 16) | (kIPv6CSumOffset << 8) | kIPv6CSumStart);
+            tcpConfig = ((kUDPv6CSumEnd << 16) | (kUDPv6CSumOffset << 8) | kUDPv6CSumStart);
+            len = E1000_TXD_CMD_DEXT;
+            mss = 0;
+
+            word2 = E1000_TXD_OPTS_TXSM;
+        }
+    }
+    if (p->vlanTag) {
+        opts |= E1000_TXD_CMD_VLE;
+        word2 |= (p->vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+    }
+    numDescs += p->numSegs;
+    lastSeg = p->numSegs - 1;
+
+    if (offloadFlags) {
+        contDesc = (struct e1000_context_desc *)&descArray[index];
+
+        bufArray[index].mbuf = NULL;
+        bufArray[index].numDescs = 0;
+
+        contDesc->lower_setup.ip_config = OSSwapHostToLittleInt32(ipConfig);
+        contDesc->upper_setup.tcp_config = OSSwapHostToLittleInt32(tcpConfig);
+        contDesc->cmd_and_length = OSSwapHostToLittleInt32(len);
+        contDesc->tcp_seg_setup.data = OSSwapHostToLittleInt32(mss);
+
+        ++index &= mask;
+    }
+    for (i = 0; i < p->numSegs; i++) {
+        desc = &descArray[index];
+        word1 = (cmd | (p->segs[i].length & 0x000fffff));
+
+        if (i == lastSeg) {
+            word1 |= opts;
+            bufArray[index].mbuf = p->m;
+            bufArray[index].numDescs = numDescs;
+        } else {
+            bufArray[index].mbuf = NULL;
+            bufArray[index].numDescs = 0;
+        }
+        desc->buffer_addr = OSSwapHostToLittleInt64(p->segs[i].location);
+        desc->lower.data = OSSwapHostToLittleInt32(word1);
+        desc->upper.data = OSSwapHostToLittleInt32(word2);
+
+        ++index &= mask;
+    }
+    return numDescs;
+}
+
+/* The builder of the driver including the VLAN handling of intelTxFillDescs(). */
+static inline UInt32 newTxWriteDescs(struct e1000_data_desc *descArray, struct intelTxBufferInfo *bufArray, UInt32 index, UInt32 mask,
+                                     struct intelTxContext *context, const struct TestTxPacket *p)
+{
+    const struct intelTxOffload *offload = getTxOffload(p->offloadFlags);
+    UInt32 opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
+    UInt32 word2 = offload->word2;
+
+    if (p->vlanTag) {
+        opts |= E1000_TXD_CMD_VLE;
+        word2 |= (p->vlanTag << E1000_TX_FLAGS_VLAN_SHIFT);
+    }
+    return intelTxWriteDescs(descArray, bufArray, index, mask, context, p->segs, p->numSegs, offload, opts, word2, p->m);
+}
+
+/*
+ * A mix of a bulk TCP stream with its ACKs, some UDP and IPv6 traffic,
+ * a few packets without offload and a VLAN tag on every 16th packet.
+ */
+static void makePacket(struct TestTxPacket *p, UInt32 n)
+{
+    static const UInt32 otherFlags[] = {
+        kChecksumIP | kChecksumUDP, kChecksumTCPIPv6, kChecksumUDPIPv6, kChecksumIP, 0
+    };
+    UInt32 kind = testRandRange(0, 99);
+    UInt32 i;
+
+    p->m = (mbuf_t)(uintptr_t)(0x1000 + n * 0x100);
+    p->vlanTag = (testRandRange(0, 15) == 0) ? testRandRange(1, 4094) : 0;
+
+    if (kind < 70) {
+        p->offloadFlags = kChecksumIP | kChecksumTCP;
+        p->numSegs = testRandRange(1, 3);
+    } else if (kind < 90) {
+        p->offloadFlags = kChecksumIP | kChecksumTCP;
+        p->numSegs = 1;
+    } else {
+        p->offloadFlags = otherFlags[testRandRange(0, 4)];
+        p->numSegs = testRandRange(1, 4);
+    }
+    for (i = 0; i < p->numSegs; i++) {
+        p->segs[i].location = 0x80000000ULL + n * 0x1000 + i * 0x400;
+        p->segs[i].length = testRandRange(1, 2048);
+    }
+}
+
+static void makePackets()
+{
+    UInt32 n;
+
+    for (n = 0; n < kNumPackets; n++)
+        makePacket(&packets[n], n);
+}
+
+static bool descEqual(const struct e1000_data_desc *a, const struct e1000_data_desc *b)
+{
+    return ((a->buffer_addr == b->buffer_addr) && (a->lower.data == b->lower.data) && (a->upper.data == b->upper.data));
+}
+
+/*
+ * Both builders must produce the same data descriptors. The old one writes
+ * a context descriptor for each offloaded packet, the new one only when the
+ * context changes, so the context the hardware holds when it processes the
+ * data descriptors must be the same.
+ */
+static void testEquivalence()
+{
+    struct e1000_data_desc oldDescs[8], newDescs[8];
+    struct intelTxBufferInfo oldBufs[8], newBufs[8];
+    struct e1000_context_desc hwContext;
+    struct e1000_context_desc *c;
+    struct intelTxContext context;
+    struct TestTxPacket p;
+    UInt32 oldNum, newNum;
+    UInt32 oldFirst, newFirst;
+    UInt32 n, i;
+
+    memset(&context, 0, sizeof(context));
+    memset(&hwContext, 0, sizeof(hwContext));
+
+    for (n = 0; n < kCompareRounds; n++) {
+        makePacket(&p, n);
+        memset(oldDescs, 0xa5, sizeof(oldDescs));
+        memset(newDescs, 0x5a, sizeof(newDescs));
+
+        oldNum = oldTxWriteDescs(oldDescs, oldBufs, 0, 7, &p);
+        newNum = newTxWriteDescs(newDescs, newBufs, 0, 7, &context, &p);
+
+        oldFirst = oldNum - p.numSegs;
+        newFirst = newNum - p.numSegs;
+
+        CHECK(oldFirst <= 1);
+        CHECK(newFirst <= oldFirst);
+
+        /* The hardware's context after the old builder's descriptors. */
+        if (oldFirst)
+            memcpy(&hwContext, &oldDescs[0], sizeof(hwContext));
+
+        if (newFirst) {
+            c = (struct e1000_context_desc *)&newDescs[0];
+            CHECK(memcmp(c, &oldDescs[0], sizeof(*c)) == 0);
+        }
+        /* Offloaded packets must find the same context in the hardware. */
+        if (p.offloadFlags) {
+            CHECK(OSSwapHostToLittleInt32(context.ipConfig) == hwContext.lower_setup.ip_config);
+            CHECK(OSSwapHostToLittleInt32(context.tcpConfig) == hwContext.upper_setup.tcp_config);
+            CHECK(OSSwapHostToLittleInt32(context.cmdLen) == hwContext.cmd_and_length);
+            CHECK(OSSwapHostToLittleInt32(context.segSetup) == hwContext.tcp_seg_setup.data);
+        }
+        for (i = 0; i < p.numSegs; i++)
+            CHECK(descEqual(&oldDescs[oldFirst + i], &newDescs[newFirst + i]));
+
+        CHECK(oldBufs[oldNum - 1].mbuf == p.m);
+        CHECK(newBufs[newNum - 1].mbuf == p.m);
+        CHECK(newBufs[newNum - 1].numDescs == newNum);
+
+        for (i = 0; i < (newNum - 1); i++)
+            CHECK((newBufs[i].mbuf == NULL) && (newBufs[i].numDescs == 0));
+    }
+}
+
+static UInt64 nsNow()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline UInt64 cyclesNow()
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static UInt32 ringSum()
+{
+    UInt32 sum = 0;
+    UInt32 i;
+
+    for (i = 0; i < kRingSize; i++)
+        sum += ringDescs[i].lower.data ^ ringDescs[i].upper.data ^ ringBufs[i].numDescs;
+
+    return sum;
+}
+
+static void report(const char *name, UInt64 ns, UInt64 cycles, UInt64 descs)
+{
+    double pkts = (double)kBenchRounds * kNumPackets;
+
+#ifdef HAVE_TSC
+    printf("  %-12s %6.2f ns/packet  %6.1f cycles/packet  %5.3f descs/packet\n", name, ns / pkts, cycles / pkts, descs / pkts);
+#else
+    printf("  %-12s %6.2f ns/packet  %5.3f descs/packet\n", name, ns / pkts, descs / pkts);
+#endif
+}
+
+static void benchmark()
+{
+    struct intelTxContext context;
+    UInt64 start, startCycles;
+    UInt64 oldNs, oldCycles, newNs, newCycles;
+    UInt64 oldDescs = 0, newDescs = 0;
+    UInt32 index;
+    UInt32 r, n;
+
+    makePackets();
+
+    /* Warm up the caches and the branch predictors. */
+    for (n = 0, index = 0; n < kNumPackets; n++)
+        index = (index + oldTxWriteDescs(ringDescs, ringBufs, index, kRingMask, &packets[n])) & kRingMask;
+
+    index = 0;
+    start = nsNow();
+    startCycles = cyclesNow();
+
+    for (r = 0; r < kBenchRounds; r++) {
+        for (n = 0; n < kNumPackets; n++) {
+            UInt32 num = oldTxWriteDescs(ringDescs, ringBufs, index, kRingMask, &packets[n]);
+
+            index = (index + num) & kRingMask;
+            oldDescs += num;
+        }
+    }
+    oldCycles = cyclesNow() - startCycles;
+    oldNs = nsNow() - start;
+    printf("  (ring checksum %08x)\n", ringSum());
+
+    memset(&context, 0, sizeof(context));
+
+    for (n = 0, index = 0; n < kNumPackets; n++)
+        index = (index + newTxWriteDescs(ringDescs, ringBufs, index, kRingMask, &context, &packets[n])) & kRingMask;
+
+    index = 0;
+    start = nsNow();
+    startCycles = cyclesNow();
+
+    for (r = 0; r < kBenchRounds; r++) {
+        for (n = 0; n < kNumPackets; n++) {
+            UInt32 num = newTxWriteDescs(ringDescs, ringBufs, index, kRingMask, &context, &packets[n]);
+
+            index = (index + num) & kRingMask;
+            newDescs += num;
+        }
+    }
+    newCycles = cyclesNow() - startCycles;
+    newNs = nsNow() - start;
+    printf("  (ring checksum %08x)\n", ringSum());
+
+    report("1.0.8", oldNs, oldCycles, oldDescs);
+    report("table", newNs, newCycles, newDescs);
+}
+
+int main()
+{
+    testEquivalence();
+
+    if (testFailures)
+        return testResult("TxBench");
+
+    printf("TxBench: %u packets per round, %u rounds, ring of %u descriptors\n", kNumPackets, kBenchRounds, kRingSize);
+    benchmark();
+
+    return testResult("TxBench");
+}
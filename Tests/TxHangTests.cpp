@@ -0,0 +1,182 @@
+/* TxHangTests.cpp -- Tests of the tx hang check's ring scan.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Packets are queued to a simulated ring with the builder of the driver
+ * and the hardware completes a prefix of them by setting DD in their last
+ * descriptor. intelTxFindPending() must return the last descriptor of the
+ * first packet which hasn't been completed, no matter how many completed
+ * packets haven't been released yet.
+ */
+
+#include "TestSupport.h"
+#include "IntelMausiTx.h"
+
+#define kRingSize   64
+#define kRingMask   (kRingSize - 1)
+#define kMaxPackets 32
+
+struct TestRing {
+    struct e1000_data_desc descs[kRingSize];
+    struct intelTxBufferInfo bufs[kRingSize];
+    struct intelTxContext context;
+    UInt32 dirty;                   /* first descriptor not released */
+    UInt32 next;                    /* first free descriptor */
+    UInt32 numPackets;
+    UInt32 last[kMaxPackets];       /* last descriptor of each packet */
+};
+
+static void ringInit(struct TestRing *ring, UInt32 start)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->dirty = ring->next = start;
+}
+
+/* Queue a packet of numSegs segments, with checksum offload if csum is set. */
+static void ringQueue(struct TestRing *ring, UInt32 numSegs, bool csum)
+{
+    const struct intelTxOffload *offload = getTxOffload(csum ? (kChecksumIP | kChecksumTCP) : 0);
+    IOPhysicalSegment segs[4];
+    UInt32 opts = (E1000_TXD_CMD_IDE | E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
+    UInt32 numDescs;
+    UInt32 i;
+
+    for (i = 0; i < numSegs; i++) {
+        segs[i].location = 0x10000 + ring->numPackets * 0x1000 + i * 0x400;
+        segs[i].length = 100 + i;
+    }
+    numDescs = intelTxWriteDescs(ring->descs, ring->bufs, ring->next, kRingMask, &ring->context, segs, numSegs,
+                                 offload, opts, offload->word2, (mbuf_t)(uintptr_t)(0x100 + ring->numPackets));
+    ring->next = (ring->next + numDescs) & kRingMask;
+    ring->last[ring->numPackets] = (ring->next - 1) & kRingMask;
+    ring->bufs[ring->last[ring->numPackets]].time = 1000 + ring->numPackets;
+    ring->numPackets++;
+}
+
+/* The hardware writes back DD to the last descriptor of a packet it has sent. */
+static void ringComplete(struct TestRing *ring, UInt32 numDone)
+{
+    UInt32 i;
+
+    for (i = 0; i < numDone; i++)
+        ring->descs[ring->last[i]].upper.data |= OSSwapHostToLittleInt32(E1000_TXD_STAT_DD);
+}
+
+static UInt32 ringFind(const struct TestRing *ring)
+{
+    return intelTxFindPending(ring->descs, ring->bufs, ring->dirty, ring->next, kRingMask);
+}
+
+/* Sent packets which haven't been released yet must not hide a stalled one. */
+static void testCompletedBeforeStalled()
+{
+    struct TestRing ring;
+    UInt32 i;
+
+    ringInit(&ring, 0);
+
+    for (i = 0; i < 6; i++)
+        ringQueue(&ring, 1 + (i % 3), true);
+
+    ringComplete(&ring, 4);
+
+    CHECK(ringFind(&ring) == ring.last[4]);
+    CHECK(ring.bufs[ringFind(&ring)].time == 1004);
+
+    /* Releasing the sent packets doesn't change the result. */
+    ring.dirty = (ring.last[3] + 1) & kRingMask;
+    CHECK(ringFind(&ring) == ring.last[4]);
+}
+
+/* The oldest pending packet is found across the end of the ring. */
+static void testWrapAround()
+{
+    struct TestRing ring;
+    UInt32 i;
+
+    ringInit(&ring, kRingSize - 5);
+
+    for (i = 0; i < 5; i++)
+        ringQueue(&ring, 2, (i & 1));
+
+    CHECK(ring.next < ring.dirty);
+
+    ringComplete(&ring, 3);
+    CHECK(ring.last[3] < ring.dirty);
+    CHECK(ringFind(&ring) == ring.last[3]);
+
+    /* A packet which straddles the end of the ring. */
+    ringInit(&ring, kRingSize - 2);
+    ringQueue(&ring, 3, true);
+    ringQueue(&ring, 1, false);
+
+    CHECK(ringFind(&ring) == ring.last[0]);
+    ringComplete(&ring, 1);
+    CHECK(ringFind(&ring) == ring.last[1]);
+}
+
+/* Nothing is pending once the hardware has sent all packets. */
+static void testAllComplete()
+{
+    struct TestRing ring;
+    UInt32 i;
+
+    ringInit(&ring, 10);
+    CHECK(ringFind(&ring) == ring.next);
+
+    for (i = 0; i < 8; i++)
+        ringQueue(&ring, 1 + (i % 4), (i % 3) != 0);
+
+    ringComplete(&ring, ring.numPackets);
+    CHECK(ringFind(&ring) == ring.next);
+}
+
+/* Random rings checked against the list of queued packets. */
+static void testRandom()
+{
+    struct TestRing ring;
+    UInt32 numDone;
+    UInt32 descs;
+    UInt32 n;
+
+    for (n = 0; n < 20000; n++) {
+        ringInit(&ring, testRandRange(0, kRingMask));
+        descs = 0;
+
+        while (ring.numPackets < kMaxPackets) {
+            UInt32 numSegs = testRandRange(1, 4);
+
+            /* Leave room for a context descriptor. */
+            if ((descs + numSegs + 1) >= kRingSize)
+                break;
+
+            ringQueue(&ring, numSegs, testRandRange(0, 1));
+            descs = (ring.next - ring.dirty) & kRingMask;
+        }
+        numDone = testRandRange(0, ring.numPackets);
+        ringComplete(&ring, numDone);
+
+        if (numDone < ring.numPackets)
+            CHECK(ringFind(&ring) == ring.last[numDone]);
+        else
+            CHECK(ringFind(&ring) == ring.next);
+    }
+}
+
+int main()
+{
+    testCompletedBeforeStalled();
+    testWrapAround();
+    testAllComplete();
+    testRandom();
+
+    return testResult("TxHangTests");
+}